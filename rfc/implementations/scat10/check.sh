@@ -0,0 +1,78 @@
+#!/bin/sh
+# Cross-worker smoke check: builds scat10, drives traffic between
+# workers (-w 2: the pipe group on worker 0, G on worker 1) and checks
+# the final [MSG_BALANCE] and [DROPS] lines.
+#   ./check.sh [workers]    (default 2)
+set -eu
+cd "$(dirname "$0")"
+W=${1:-2}
+# G is affinity group 5 and lands on worker 5 % W; it must not share
+# worker 0 with the pipe.
+[ "$W" -ge 2 ] && [ $((5 % W)) -ne 0 ] || { echo "usage: $0 [workers: 2-4 or 6+]"; exit 2; }
+T=$(mktemp -d)
+trap 'rm -rf "$T"' EXIT
+CC=${CC:-gcc}
+$CC -std=c11 -Wall -Wextra -Werror -O2 cmrc.c -o "$T/cmrc"
+"$T/cmrc" scat10.rules > "$T/scat10_rules.h"
+cmp -s "$T/scat10_rules.h" scat10_rules.h || { echo "scat10_rules.h is stale"; exit 1; }
+$CC -std=c11 -Wall -Wextra -Werror -O2 -pthread scat10.c -o "$T/scat10"
+fail=0
+# expect FILE PATTERN: the line must appear in FILE.
+expect()
+{
+    if ! grep -q -- "$2" "$1"; then
+        echo "FAIL: no \"$2\""
+        fail=1
+    fi
+}
+# Stdin: boot traffic (A and B are denied one Message each), pipe
+# lines crossing to G, and two readings G coalesces.
+{
+    echo hello
+    i=0
+    while [ $i -lt 500 ]; do
+        echo "pipe x$i"
+        i=$((i+1))
+    done
+    echo "t 10 g cpu 90"
+    echo "t 10 g cpu 10"
+} | "$T/scat10" -w "$W" > "$T/stdin.out"
+tail -n 4 "$T/stdin.out"
+tail -n 4 "$T/stdin.out" | grep '^\[MSG_BALANCE\]' > "$T/stdin.bal" || true
+expect "$T/stdin.bal" ' pending=0 balance=0$'
+expect "$T/stdin.out" '^\[DROPS\] doer=A capability_denied=1$'
+expect "$T/stdin.out" '^\[DROPS\] doer=B capability_denied=1$'
+expect "$T/stdin.out" '^\[DROPS\] doer=G superseded=1$'
+# Load: 300 producers per step into the pipe, more than the 64-cell
+# remote ring, all with one key, so G supersedes most of them. -l
+# exits 1 on a nonzero balance.
+"$T/scat10" -w "$W" -l mode=closed,producers=300,count=3000,to=pipe,size=fixed:6 > "$T/load.out" \
+    || { echo "FAIL: load exited $?"; fail=1; }
+tail -n 4 "$T/load.out"
+expect "$T/load.out" '^\[MSG_BALANCE\] .* pending=0 balance=0$'
+expect "$T/load.out" '^\[DROPS\] doer=G superseded=[1-9]'
+if grep '^\[DROPS\]' "$T/load.out" "$T/stdin.out" | grep -q 'inbox_full\|no_route\|kind_unhandled'; then
+    echo "FAIL: unexpected drop reason"
+    fail=1
+fi
+# Memory: 2M Messages created on the main thread and released on a
+# worker must reuse Envelopes, not pile them up on the worker's free
+# list. Peak RSS (VmHWM) has to stay bounded; Linux only.
+if [ -r /proc/self/status ]; then
+    "$T/scat10" -w "$W" -l mode=closed,producers=200,count=2000000,duration=60,to=a,size=fixed:8 > "$T/rss.out" &
+    pid=$!
+    hwm=0
+    while v=$(awk '/^VmHWM/{print $2}' "/proc/$pid/status" 2>/dev/null) && [ -n "$v" ]; do
+        hwm=$v
+        sleep 0.05
+    done
+    wait $pid || { echo "FAIL: rss run exited $?"; fail=1; }
+    echo "rss: peak ${hwm} kB for 2M Messages"
+    expect "$T/rss.out" '^\[MSG_BALANCE\] .* pending=0 balance=0$'
+    if [ "$hwm" -gt 32768 ]; then
+        echo "FAIL: peak RSS ${hwm} kB over 32 MB"
+        fail=1
+    fi
+fi
+[ $fail -eq 0 ] && echo "check: ok (-w $W)"
+exit $fail
@@ -0,0 +1,1142 @@
+/*
+ * cmrc — CMR rule compiler
+ *
+ * Turns a declarative rule file into a C header holding the flat,
+ * read-only validation and routing image used by scat10.c.
+ * Rules are fixed at design time (Axiom 5); the runtime only
+ * performs table lookups on what this tool emits.
+ *
+ * Build: gcc -std=c11 -Wall -Wextra -O2 cmrc.c -o cmrc
+ * Use:   ./cmrc scat10.rules > scat10_rules.h
+ *
+ * Rule file grammar (one rule per line, '#' starts a comment):
+ *
+ *   kind NAME
+ *   doer NAME caps CAP[,CAP...] on KIND FUNC [on KIND FUNC...]
+ *   doer NAME caps CAP[,CAP...] handler FUNC
+ *   target NAME -> DOER [DOER...]
+ *   boundary stdin -> TARGET cap CAP kind KIND
+ *   topic NAME cap CAP
+ *   pool NAME caps CAP[,CAP...] on KIND FUNC [on KIND FUNC...]
+ *   forward DOER|POOL -> TARGET
+ *   affinity NAME -> DOER [DOER...]
+ *   inbox DOER|POOL high N [low M]
+ *   blocking DOER|POOL [KIND...]
+ *   coalesce DOER|POOL [KIND...]
+ *   match prefix|contains TEXT -> TARGET [TARGET...]
+ *   match byte CLASS -> TARGET [TARGET...]
+ *
+ * Message kinds must be declared before use. "on KIND FUNC" binds a
+ * handler to one kind; "handler FUNC" binds it to every declared kind.
+ * The runtime dispatches with a switch over (doer, kind) built from
+ * these bindings, and rejects kinds a Doer has no handler for before
+ * they are enqueued.
+ *
+ * A pool declares a member template and a target of the same name;
+ * members are added at runtime and share the template's capabilities.
+ *
+ * "forward" names the target a Doer's handler passes Messages on to
+ * (runtime_forward). An affinity group lists Doers that always run on
+ * the same worker thread; Doers outside any group form their own.
+ * A forward from doer X to a target holding only doer Y is fused (Y's
+ * handler runs right after X's, without an inbox) when X is Y's only
+ * forwarding producer, both share an affinity group, Y holds every
+ * capability and handles every kind X does, and the edge is not on a
+ * forward cycle.
+ *
+ * "inbox" sets a Doer's watermarks: more than N queued Messages are
+ * refused as inbox_full, and at or below M queued the inbox hands its
+ * spare overflow segment back. Unset values use the runtime defaults.
+ *
+ * "blocking" marks a Doer's handlers (for the listed kinds, or all of
+ * them) as slow: the runtime runs them on its offload threads instead
+ * of a worker. A blocking Doer is never the target of a fused hop.
+ *
+ * "coalesce" makes a Doer's inbox keep only the newest Message per key
+ * for the listed kinds (or all): the key is the kind and the first
+ * word of the payload. A Message whose key is still queued takes over
+ * its slot, and the one it replaces is dropped as superseded.
+ *
+ * "match" routes boundary lines that start with no verb by content:
+ * such a line goes to every target of every rule it matches, and to
+ * the boundary target only if it matches none. "prefix" matches at the
+ * start of the line, "contains" anywhere, "byte" any single byte of
+ * CLASS (comma-separated bytes and LO-HI ranges). TEXT and CLASS take
+ * the escapes \s (space), \t, \\ and \xHH. Match rules follow the
+ * boundary rule and their targets must handle its kind. All rules
+ * compile into one Aho-Corasick automaton over byte classes: the
+ * runtime makes one table step per payload byte, however many rules
+ * there are.
+ *
+ * Every target also becomes a boundary verb (its lower-cased name),
+ * compiled with the control verbs "exit", "grant", "revoke", "subscribe",
+ * "unsubscribe" and "publish" into a perfect hash table.
+ *
+ * Every error is reported with its line number and rejects the whole
+ * rule set: a partially compiled rule set does not exist.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#define CMRC_NAME_LEN 63
+#define CMRC_CAP_LIMIT 65536
+#define CMRC_MAX_TOKENS 4096
+#define CMRC_MAX_KINDS 32
+#define CMRC_MATCH_TARGETS 64   // a match result is one 64-bit target set
+
+typedef struct{
+    int kind;
+    char func[CMRC_NAME_LEN+1];
+}RuleHandler;
+typedef struct{
+    char name[CMRC_NAME_LEN+1];
+    int *caps;
+    int cap_count;
+    RuleHandler *on;
+    int on_count;
+    uint32_t kind_mask;
+    int forward;    // target index, or -1
+    int affinity;   // affinity group index, or -1
+    int inbox_high; // inbox watermarks, 0 for the runtime default
+    int inbox_low;
+    uint32_t blocking_mask; // kinds whose handler runs on the offload pool
+    uint32_t coalesce_mask; // kinds queued latest-value-wins
+}RuleDoer;
+typedef struct{
+    char name[CMRC_NAME_LEN+1];
+    int *doers;
+    int doer_count;
+    int pool;       // pool index, or -1 for a doer list
+}RuleTarget;
+typedef struct{
+    char name[CMRC_NAME_LEN+1];
+    int cap;
+}RuleTopic;
+// One match rule: a sequence of byte sets, one per position.
+typedef struct{
+    int prefix;         // anchored at the start of the line
+    uint8_t (*pos)[32];
+    int len;
+    uint64_t targets;
+}RuleMatch;
+typedef struct{
+    RuleDoer *doers;
+    int doer_count,doer_cap;
+    RuleTarget *targets;
+    int target_count,target_cap;
+    RuleTopic *topics;
+    int topic_count,topic_cap;
+    RuleDoer *pools;
+    int pool_count,pool_cap;
+    RuleMatch *matches;
+    int match_count,match_cap;
+    char kinds[CMRC_MAX_KINDS][CMRC_NAME_LEN+1];
+    int kind_count;
+    int affinity_count;
+    int stdin_kind;
+    int stdin_target;
+    int stdin_cap;
+    int cap_max;
+}RuleSet;
+
+// === NAME INDEX ===
+// Open-addressing index so large rule sets compile in linear time.
+// Keys are owned copies: the rule arrays they name get reallocated.
+typedef struct{
+    const char **keys;
+    int *vals;
+    size_t cap;
+    size_t count;
+}NameIndex;
+static size_t name_hash(const char *s)
+{
+    size_t h=1469598103934665603ull;
+    while(*s){h^=(unsigned char)*s++;h*=1099511628211ull;}
+    return h;
+}
+static int index_find(const NameIndex *ix,const char *name)
+{
+    if(!ix->cap) return -1;
+    size_t h=name_hash(name)&(ix->cap-1);
+    while(ix->keys[h])
+    {
+        if(strcmp(ix->keys[h],name)==0) return ix->vals[h];
+        h=(h+1)&(ix->cap-1);
+    }
+    return -1;
+}
+static void index_put(NameIndex *ix,const char *name,int val)
+{
+    if((ix->count+1)*2>ix->cap)
+    {
+        NameIndex n={0};
+        n.cap=ix->cap ? ix->cap*2 : 64;
+        n.keys=calloc(n.cap,sizeof(*n.keys));
+        n.vals=calloc(n.cap,sizeof(*n.vals));
+        for(size_t i=0;i<ix->cap;i++)
+        {
+            if(ix->keys[i]) index_put(&n,ix->keys[i],ix->vals[i]);
+        }
+        free(ix->keys);
+        free(ix->vals);
+        *ix=n;
+    }
+    size_t h=name_hash(name)&(ix->cap-1);
+    while(ix->keys[h]) h=(h+1)&(ix->cap-1);
+    ix->keys[h]=name;
+    ix->vals[h]=val;
+    ix->count++;
+}
+
+// === PARSE ===
+static const char *g_path;
+static int g_line;
+static void die(const char *msg,const char *arg)
+{
+    fprintf(stderr,"%s:%d: %s%s%s\n",g_path,g_line,msg,arg ? ": " : "",arg ? arg : "");
+    exit(1);
+}
+static int valid_ident(const char *s)
+{
+    if(!(isalpha((unsigned char)*s)||*s=='_')) return 0;
+    for(;*s;s++)
+    {
+        if(!(isalnum((unsigned char)*s)||*s=='_')) return 0;
+    }
+    return 1;
+}
+static void check_name(const char *s)
+{
+    if(strlen(s)>CMRC_NAME_LEN||!valid_ident(s)) die("invalid name",s);
+}
+static int parse_cap(const char *s)
+{
+    char *end;
+    long v=strtol(s,&end,10);
+    if(*s=='\0'||*end!='\0'||v<1||v>=CMRC_CAP_LIMIT) die("invalid capability",s);
+    return (int)v;
+}
+static int split(char *line,char **tok)
+{
+    int n=0;
+    char *save;
+    for(char *t=strtok_r(line," \t\r\n",&save);t;t=strtok_r(NULL," \t\r\n",&save))
+    {
+        if(*t=='#') break;
+        if(n==CMRC_MAX_TOKENS) die("too many tokens",NULL);
+        tok[n++]=t;
+    }
+    return n;
+}
+static int find_kind(const RuleSet *rs,const char *name)
+{
+    for(int i=0;i<rs->kind_count;i++)
+    {
+        if(strcmp(rs->kinds[i],name)==0) return i;
+    }
+    die("unknown kind",name);
+    return -1;
+}
+static void parse_kind(RuleSet *rs,char **tok,int n)
+{
+    if(n!=2) die("expected: kind NAME",NULL);
+    check_name(tok[1]);
+    for(int i=0;i<rs->kind_count;i++)
+    {
+        if(strcmp(rs->kinds[i],tok[1])==0) die("duplicate kind",tok[1]);
+    }
+    if(rs->kind_count==CMRC_MAX_KINDS) die("too many kinds",tok[1]);
+    strcpy(rs->kinds[rs->kind_count++],tok[1]);
+}
+static void bind_handler(RuleDoer *d,int kind,const char *func)
+{
+    check_name(func);
+    if(d->kind_mask&(1u<<kind)) die("kind bound twice",func);
+    d->on=realloc(d->on,(size_t)(d->on_count+1)*sizeof(*d->on));
+    d->on[d->on_count].kind=kind;
+    strcpy(d->on[d->on_count].func,func);
+    d->on_count++;
+    d->kind_mask|=1u<<kind;
+}
+// Parses "NAME caps CAP[,CAP...] {on KIND FUNC | handler FUNC}..." into d.
+static void parse_doer_body(RuleSet *rs,RuleDoer *d,char **tok,int n)
+{
+    if(n<2) die("expected: NAME caps CAP[,CAP...] on KIND FUNC ...",tok[0]);
+    check_name(tok[1]);
+    memset(d,0,sizeof(*d));
+    strcpy(d->name,tok[1]);
+    d->forward=-1;
+    d->affinity=-1;
+    d->inbox_high=0;
+    d->inbox_low=0;
+    for(int i=2;i<n;)
+    {
+        if(strcmp(tok[i],"caps")==0&&i+1<n)
+        {
+            char *save;
+            for(char *c=strtok_r(tok[i+1],",",&save);c;c=strtok_r(NULL,",",&save))
+            {
+                d->caps=realloc(d->caps,(d->cap_count+1)*sizeof(*d->caps));
+                d->caps[d->cap_count]=parse_cap(c);
+                if(d->caps[d->cap_count]>rs->cap_max) rs->cap_max=d->caps[d->cap_count];
+                d->cap_count++;
+            }
+            i+=2;
+        }
+        else if(strcmp(tok[i],"on")==0&&i+2<n)
+        {
+            bind_handler(d,find_kind(rs,tok[i+1]),tok[i+2]);
+            i+=3;
+        }
+        else if(strcmp(tok[i],"handler")==0&&i+1<n)
+        {
+            if(rs->kind_count==0) die("handler before any kind is declared",tok[i+1]);
+            for(int k=0;k<rs->kind_count;k++) bind_handler(d,k,tok[i+1]);
+            i+=2;
+        }
+        else
+        {
+            die("unexpected token",tok[i]);
+        }
+    }
+    if(d->cap_count==0) die("doer without capabilities",tok[1]);
+    if(d->on_count==0) die("doer without handlers",tok[1]);
+}
+static void parse_doer(RuleSet *rs,NameIndex *doers,char **tok,int n)
+{
+    if(n>1&&index_find(doers,tok[1])>=0) die("duplicate doer",tok[1]);
+    if(rs->doer_count==rs->doer_cap)
+    {
+        rs->doer_cap=rs->doer_cap ? rs->doer_cap*2 : 16;
+        rs->doers=realloc(rs->doers,rs->doer_cap*sizeof(*rs->doers));
+    }
+    RuleDoer *d=&rs->doers[rs->doer_count];
+    parse_doer_body(rs,d,tok,n);
+    index_put(doers,strdup(d->name),rs->doer_count++);
+}
+static RuleTarget *add_target(RuleSet *rs,NameIndex *targets,const char *name)
+{
+    check_name(name);
+    if(index_find(targets,name)>=0) die("duplicate target",name);
+    if(rs->target_count==rs->target_cap)
+    {
+        rs->target_cap=rs->target_cap ? rs->target_cap*2 : 16;
+        rs->targets=realloc(rs->targets,rs->target_cap*sizeof(*rs->targets));
+    }
+    RuleTarget *t=&rs->targets[rs->target_count];
+    memset(t,0,sizeof(*t));
+    strcpy(t->name,name);
+    t->pool=-1;
+    index_put(targets,strdup(t->name),rs->target_count++);
+    return t;
+}
+static void parse_pool(RuleSet *rs,NameIndex *targets,char **tok,int n)
+{
+    if(rs->pool_count==rs->pool_cap)
+    {
+        rs->pool_cap=rs->pool_cap ? rs->pool_cap*2 : 16;
+        rs->pools=realloc(rs->pools,rs->pool_cap*sizeof(*rs->pools));
+    }
+    parse_doer_body(rs,&rs->pools[rs->pool_count],tok,n);
+    RuleTarget *t=add_target(rs,targets,tok[1]);
+    t->pool=rs->pool_count++;
+}
+static void parse_target(RuleSet *rs,NameIndex *doers,NameIndex *targets,char **tok,int n)
+{
+    if(n<4||strcmp(tok[2],"->")!=0) die("expected: target NAME -> DOER [DOER...]",NULL);
+    RuleTarget *t=add_target(rs,targets,tok[1]);
+    t->doers=malloc((n-3)*sizeof(*t->doers));
+    for(int i=3;i<n;i++)
+    {
+        int d=index_find(doers,tok[i]);
+        if(d<0) die("unknown doer",tok[i]);
+        for(int k=0;k<t->doer_count;k++)
+        {
+            if(t->doers[k]==d) die("doer listed twice",tok[i]);
+        }
+        t->doers[t->doer_count++]=d;
+    }
+}
+// Registration-time check: every receiver of boundary lines must
+// handle the boundary kind.
+static void check_boundary_kind(const RuleSet *rs,const RuleTarget *t)
+{
+    if(t->pool>=0&&!(rs->pools[t->pool].kind_mask&(1u<<rs->stdin_kind)))
+        die("boundary pool has no handler for kind",rs->kinds[rs->stdin_kind]);
+    for(int i=0;i<t->doer_count;i++)
+    {
+        if(!(rs->doers[t->doers[i]].kind_mask&(1u<<rs->stdin_kind)))
+            die("boundary target has a doer without handler for kind",rs->doers[t->doers[i]].name);
+    }
+}
+static void parse_boundary(RuleSet *rs,NameIndex *targets,char **tok,int n)
+{
+    if(n!=8||strcmp(tok[1],"stdin")!=0||strcmp(tok[2],"->")!=0||strcmp(tok[4],"cap")!=0
+       ||strcmp(tok[6],"kind")!=0)
+        die("expected: boundary stdin -> TARGET cap CAP kind KIND",NULL);
+    if(rs->stdin_target>=0) die("duplicate boundary",tok[1]);
+    rs->stdin_target=index_find(targets,tok[3]);
+    if(rs->stdin_target<0) die("unknown target",tok[3]);
+    rs->stdin_cap=parse_cap(tok[5]);
+    rs->stdin_kind=find_kind(rs,tok[7]);
+    check_boundary_kind(rs,&rs->targets[rs->stdin_target]);
+}
+// Decodes one byte of TEXT or CLASS at *s: a literal or an escape.
+static int parse_byte(const char **s)
+{
+    const char *p=*s;
+    if(*p!='\\')
+    {
+        *s=p+1;
+        return (unsigned char)*p;
+    }
+    if(p[1]=='s'||p[1]=='t'||p[1]=='\\')
+    {
+        *s=p+2;
+        return p[1]=='s' ? ' ' : p[1]=='t' ? '\t' : '\\';
+    }
+    if(p[1]=='x'&&isxdigit((unsigned char)p[2])&&isxdigit((unsigned char)p[3]))
+    {
+        char hex[3]={p[2],p[3],0};
+        *s=p+4;
+        return (int)strtol(hex,NULL,16);
+    }
+    die("invalid escape",p);
+    return -1;
+}
+static void parse_match(RuleSet *rs,NameIndex *targets,char **tok,int n)
+{
+    if(n<5||strcmp(tok[3],"->")!=0)
+        die("expected: match prefix|contains|byte TEXT -> TARGET [TARGET...]",NULL);
+    if(rs->stdin_target<0) die("match before the boundary rule",NULL);
+    if(rs->match_count==rs->match_cap)
+    {
+        rs->match_cap=rs->match_cap ? rs->match_cap*2 : 16;
+        rs->matches=realloc(rs->matches,rs->match_cap*sizeof(*rs->matches));
+    }
+    RuleMatch *m=&rs->matches[rs->match_count];
+    memset(m,0,sizeof(*m));
+    size_t text=strlen(tok[2]);
+    m->pos=calloc(text ? text : 1,sizeof(*m->pos));
+    if(strcmp(tok[1],"prefix")==0||strcmp(tok[1],"contains")==0)
+    {
+        m->prefix=tok[1][0]=='p';
+        for(const char *p=tok[2];*p;m->len++)
+        {
+            int c=parse_byte(&p);
+            m->pos[m->len][c>>3]|=(uint8_t)(1u<<(c&7));
+        }
+    }
+    else if(strcmp(tok[1],"byte")==0)
+    {
+        m->len=1;
+        for(const char *p=tok[2];*p;)
+        {
+            int lo=parse_byte(&p),hi=lo;
+            if(*p=='-'&&p[1])
+            {
+                p++;
+                hi=parse_byte(&p);
+            }
+            if(hi<lo) die("empty byte range",tok[2]);
+            for(int c=lo;c<=hi;c++) m->pos[0][c>>3]|=(uint8_t)(1u<<(c&7));
+            if(*p==',') p++;
+            else if(*p) die("expected , in byte class",tok[2]);
+        }
+    }
+    else
+        die("expected prefix, contains or byte",tok[1]);
+    if(m->len==0) die("empty match",tok[2]);
+    for(int i=4;i<n;i++)
+    {
+        int t=index_find(targets,tok[i]);
+        if(t<0) die("unknown target",tok[i]);
+        if(t>=CMRC_MATCH_TARGETS) die("match target beyond the first 64 targets",tok[i]);
+        check_boundary_kind(rs,&rs->targets[t]);
+        m->targets|=1ull<<t;
+    }
+    rs->match_count++;
+}
+static void parse_topic(RuleSet *rs,NameIndex *topics,char **tok,int n)
+{
+    if(n!=4||strcmp(tok[2],"cap")!=0) die("expected: topic NAME cap CAP",NULL);
+    check_name(tok[1]);
+    if(index_find(topics,tok[1])>=0) die("duplicate topic",tok[1]);
+    if(rs->topic_count==rs->topic_cap)
+    {
+        rs->topic_cap=rs->topic_cap ? rs->topic_cap*2 : 16;
+        rs->topics=realloc(rs->topics,rs->topic_cap*sizeof(*rs->topics));
+    }
+    RuleTopic *t=&rs->topics[rs->topic_count];
+    strcpy(t->name,tok[1]);
+    t->cap=parse_cap(tok[3]);
+    if(t->cap>rs->cap_max) rs->cap_max=t->cap;
+    index_put(topics,strdup(t->name),rs->topic_count++);
+}
+static RuleDoer *find_doer_or_pool(RuleSet *rs,NameIndex *doers,NameIndex *targets,const char *name)
+{
+    int i=index_find(doers,name);
+    if(i>=0) return &rs->doers[i];
+    int t=index_find(targets,name);
+    if(t<0||rs->targets[t].pool<0) die("unknown doer or pool",name);
+    return &rs->pools[rs->targets[t].pool];
+}
+static void parse_forward(RuleSet *rs,NameIndex *doers,NameIndex *targets,char **tok,int n)
+{
+    if(n!=4||strcmp(tok[2],"->")!=0) die("expected: forward DOER|POOL -> TARGET",NULL);
+    RuleDoer *d=find_doer_or_pool(rs,doers,targets,tok[1]);
+    if(d->forward>=0) die("doer forwards twice",tok[1]);
+    d->forward=index_find(targets,tok[3]);
+    if(d->forward<0) die("unknown target",tok[3]);
+}
+static int parse_count(const char *s)
+{
+    char *end;
+    long v=strtol(s,&end,10);
+    if(*s=='\0'||*end!='\0'||v<1||v>INT32_MAX) die("invalid count",s);
+    return (int)v;
+}
+static void parse_inbox(RuleSet *rs,NameIndex *doers,NameIndex *targets,char **tok,int n)
+{
+    if((n!=4&&n!=6)||strcmp(tok[2],"high")!=0||(n==6&&strcmp(tok[4],"low")!=0))
+        die("expected: inbox DOER|POOL high N [low M]",NULL);
+    RuleDoer *d=find_doer_or_pool(rs,doers,targets,tok[1]);
+    if(d->inbox_high) die("inbox watermarks set twice",tok[1]);
+    d->inbox_high=parse_count(tok[3]);
+    if(n==6)
+    {
+        d->inbox_low=parse_count(tok[5]);
+        if(d->inbox_low>=d->inbox_high) die("low watermark not below high",tok[5]);
+    }
+}
+static void parse_blocking(RuleSet *rs,NameIndex *doers,NameIndex *targets,char **tok,int n)
+{
+    if(n<2) die("expected: blocking DOER|POOL [KIND...]",NULL);
+    RuleDoer *d=find_doer_or_pool(rs,doers,targets,tok[1]);
+    if(d->blocking_mask) die("doer marked blocking twice",tok[1]);
+    for(int i=2;i<n;i++)
+    {
+        int k=find_kind(rs,tok[i]);
+        if(!(d->kind_mask&(1u<<k))) die("doer has no handler for kind",tok[i]);
+        d->blocking_mask|=1u<<k;
+    }
+    if(n==2) d->blocking_mask=d->kind_mask;
+}
+static void parse_coalesce(RuleSet *rs,NameIndex *doers,NameIndex *targets,char **tok,int n)
+{
+    if(n<2) die("expected: coalesce DOER|POOL [KIND...]",NULL);
+    RuleDoer *d=find_doer_or_pool(rs,doers,targets,tok[1]);
+    if(d->coalesce_mask) die("doer marked coalesce twice",tok[1]);
+    for(int i=2;i<n;i++)
+    {
+        int k=find_kind(rs,tok[i]);
+        if(!(d->kind_mask&(1u<<k))) die("doer has no handler for kind",tok[i]);
+        d->coalesce_mask|=1u<<k;
+    }
+    if(n==2) d->coalesce_mask=d->kind_mask;
+}
+static void parse_affinity(RuleSet *rs,NameIndex *doers,NameIndex *affinities,char **tok,int n)
+{
+    if(n<4||strcmp(tok[2],"->")!=0) die("expected: affinity NAME -> DOER [DOER...]",NULL);
+    check_name(tok[1]);
+    if(index_find(affinities,tok[1])>=0) die("duplicate affinity group",tok[1]);
+    for(int i=3;i<n;i++)
+    {
+        int d=index_find(doers,tok[i]);
+        if(d<0) die("unknown doer",tok[i]);
+        if(rs->doers[d].affinity>=0) die("doer already in an affinity group",tok[i]);
+        rs->doers[d].affinity=rs->affinity_count;
+    }
+    index_put(affinities,strdup(tok[1]),rs->affinity_count++);
+}
+static void parse_rules(RuleSet *rs,FILE *in)
+{
+    NameIndex doers={0},targets={0},topics={0},affinities={0};
+    static char *tok[CMRC_MAX_TOKENS];
+    char *line=NULL;
+    size_t cap=0;
+    rs->stdin_target=-1;
+    while(getline(&line,&cap,in)>=0)
+    {
+        g_line++;
+        int n=split(line,tok);
+        if(n==0) continue;
+        if(strcmp(tok[0],"doer")==0)
+            parse_doer(rs,&doers,tok,n);
+        else if(strcmp(tok[0],"target")==0)
+            parse_target(rs,&doers,&targets,tok,n);
+        else if(strcmp(tok[0],"boundary")==0)
+            parse_boundary(rs,&targets,tok,n);
+        else if(strcmp(tok[0],"topic")==0)
+            parse_topic(rs,&topics,tok,n);
+        else if(strcmp(tok[0],"pool")==0)
+            parse_pool(rs,&targets,tok,n);
+        else if(strcmp(tok[0],"kind")==0)
+            parse_kind(rs,tok,n);
+        else if(strcmp(tok[0],"forward")==0)
+            parse_forward(rs,&doers,&targets,tok,n);
+        else if(strcmp(tok[0],"affinity")==0)
+            parse_affinity(rs,&doers,&affinities,tok,n);
+        else if(strcmp(tok[0],"inbox")==0)
+            parse_inbox(rs,&doers,&targets,tok,n);
+        else if(strcmp(tok[0],"blocking")==0)
+            parse_blocking(rs,&doers,&targets,tok,n);
+        else if(strcmp(tok[0],"coalesce")==0)
+            parse_coalesce(rs,&doers,&targets,tok,n);
+        else if(strcmp(tok[0],"match")==0)
+            parse_match(rs,&targets,tok,n);
+        else
+            die("unknown rule",tok[0]);
+    }
+    free(line);
+    g_line=0;
+    if(rs->doer_count==0) die("no doers declared",NULL);
+    if(rs->stdin_target<0) die("no boundary stdin rule",NULL);
+}
+
+// === EMIT ===
+static void upper(char *out,const char *in)
+{
+    while(*in) *out++=(char)toupper((unsigned char)*in++);
+    *out='\0';
+}
+static void lower(char *out,const char *in)
+{
+    while(*in) *out++=(char)tolower((unsigned char)*in++);
+    *out='\0';
+}
+// First (up to) 8 bytes of a verb, little-endian, zero padded.
+// Must match verb_prefix() in scat10.c.
+static uint64_t verb_prefix(const char *s,size_t len)
+{
+    uint64_t v=0;
+    for(size_t i=0;i<len&&i<8;i++) v|=(uint64_t)(unsigned char)s[i]<<(8*i);
+    return v;
+}
+static unsigned verb_hash(uint64_t prefix,size_t len,uint64_t mul,int bits)
+{
+    return (unsigned)(((prefix^len)*mul)>>(64-bits));
+}
+// Boundary verbs: a perfect hash over (prefix, length). The multiplier
+// is searched here so the runtime does one multiply, one shift and one
+// compare per line.
+static const char *const control_verbs[]={"exit","grant","revoke","subscribe","unsubscribe","publish"};
+#define CONTROL_VERB_COUNT ((int)(sizeof(control_verbs)/sizeof(control_verbs[0])))
+static void emit_verbs(const RuleSet *rs,FILE *out)
+{
+    int n=rs->target_count+CONTROL_VERB_COUNT;
+    char (*verbs)[CMRC_NAME_LEN+1]=malloc((size_t)n*sizeof(*verbs));
+    int *target=malloc((size_t)n*sizeof(*target));
+    for(int i=0;i<rs->target_count;i++)
+    {
+        lower(verbs[i],rs->targets[i].name);
+        for(int c=0;c<CONTROL_VERB_COUNT;c++)
+        {
+            if(strcmp(verbs[i],control_verbs[c])==0) die("target name is reserved",rs->targets[i].name);
+        }
+        for(int k=0;k<i;k++)
+        {
+            if(strcmp(verbs[k],verbs[i])==0) die("targets differ only in case",rs->targets[i].name);
+        }
+        target[i]=i;
+    }
+    // Control verbs get negative targets: -1 exit, -2 grant, -3 revoke,
+    // -4 subscribe, -5 unsubscribe, -6 publish.
+    for(int c=0;c<CONTROL_VERB_COUNT;c++)
+    {
+        strcpy(verbs[rs->target_count+c],control_verbs[c]);
+        target[rs->target_count+c]=-1-c;
+    }
+    int bits=1;
+    while((1<<bits)<2*n) bits++;
+    uint64_t mul=0;
+    int *slot=NULL;
+    uint64_t seed=0x9e3779b97f4a7c15ull;
+    for(int attempt=0;;attempt++)
+    {
+        if(attempt&&attempt%1000==0) bits++;
+        seed^=seed<<13;
+        seed^=seed>>7;
+        seed^=seed<<17;
+        mul=seed|1;
+        free(slot);
+        slot=malloc(sizeof(*slot)<<bits);
+        for(int i=0;i<(1<<bits);i++) slot[i]=-1;
+        int ok=1;
+        for(int i=0;i<n&&ok;i++)
+        {
+            size_t len=strlen(verbs[i]);
+            unsigned h=verb_hash(verb_prefix(verbs[i],len),len,mul,bits);
+            if(slot[h]>=0) ok=0;
+            else slot[h]=i;
+        }
+        if(ok) break;
+    }
+    fprintf(out,"// Boundary verbs: perfect hash over (first 8 bytes, length).\n");
+    fprintf(out,"#define RULES_VERB_BITS %d\n",bits);
+    fprintf(out,"#define RULES_VERB_MUL 0x%llxull\n",(unsigned long long)mul);
+    fprintf(out,"#define RULES_VERB_EXIT (-1)\n");
+    fprintf(out,"#define RULES_VERB_GRANT (-2)\n");
+    fprintf(out,"#define RULES_VERB_REVOKE (-3)\n");
+    fprintf(out,"#define RULES_VERB_SUBSCRIBE (-4)\n");
+    fprintf(out,"#define RULES_VERB_UNSUBSCRIBE (-5)\n");
+    fprintf(out,"#define RULES_VERB_PUBLISH (-6)\n");
+    fprintf(out,"typedef struct{\n    uint64_t prefix;\n    uint32_t len;\n    int32_t target;\n    const char *verb;\n}RulesVerb;\n");
+    fprintf(out,"static const RulesVerb rules_verbs[1<<RULES_VERB_BITS]={\n");
+    for(int h=0;h<(1<<bits);h++)
+    {
+        if(slot[h]<0) continue;
+        int i=slot[h];
+        size_t len=strlen(verbs[i]);
+        fprintf(out,"    [%d]={0x%llxull,%zu,%d,\"%s\"},\n",h,
+                (unsigned long long)verb_prefix(verbs[i],len),len,target[i],verbs[i]);
+    }
+    fprintf(out,"};\n\n");
+    free(slot);
+    free(verbs);
+    free(target);
+}
+// Content routing: one Aho-Corasick automaton for all match rules.
+// Bytes that every rule position treats alike share a class, so the
+// transition table has one column per class, plus one for the
+// start-of-line symbol that anchors prefix rules. Each state's target
+// set already includes those of its failure chain: matching is one
+// lookup and one OR per byte.
+static void emit_matcher(const RuleSet *rs,FILE *out)
+{
+    // Byte classes: refine the partition by every position's byte set.
+    int cls[256]={0};
+    int classes=1;
+    for(int r=0;r<rs->match_count;r++)
+    {
+        for(int k=0;k<rs->matches[r].len;k++)
+        {
+            const uint8_t *set=rs->matches[r].pos[k];
+            int split[256][2];
+            memset(split,-1,sizeof(split));
+            int next=0;
+            for(int c=0;c<256;c++)
+            {
+                int in=(set[c>>3]>>(c&7))&1;
+                if(split[cls[c]][in]<0) split[cls[c]][in]=next++;
+                cls[c]=split[cls[c]][in];
+            }
+            classes=next;
+        }
+    }
+    int start=classes;
+    int cols=classes+1;
+    // Trie over class symbols; a position naming several classes
+    // branches into each.
+    int cap=64,states=1;
+    int *go=malloc((size_t)cap*cols*sizeof(*go));
+    uint64_t *targets=calloc((size_t)cap,sizeof(*targets));
+    for(int c=0;c<cols;c++) go[c]=-1;
+    int *front=NULL,*grown=NULL;
+    for(int r=0;r<rs->match_count;r++)
+    {
+        const RuleMatch *m=&rs->matches[r];
+        int front_count=1;
+        front=realloc(front,sizeof(*front));
+        front[0]=0;
+        for(int k=-1;k<m->len;k++)
+        {
+            if(k<0&&!m->prefix) continue;
+            // Position -1 of a prefix rule is the start-of-line symbol.
+            char hit[257]={0};
+            if(k<0) hit[start]=1;
+            for(int b=0;b<256&&k>=0;b++)
+                if((m->pos[k][b>>3]>>(b&7))&1) hit[cls[b]]=1;
+            int grown_count=0;
+            for(int f=0;f<front_count;f++)
+            {
+                for(int c=0;c<cols;c++)
+                {
+                    if(!hit[c]) continue;
+                    size_t edge=(size_t)front[f]*cols+c;
+                    if(go[edge]<0)
+                    {
+                        if(states==cap)
+                        {
+                            cap*=2;
+                            go=realloc(go,(size_t)cap*cols*sizeof(*go));
+                            targets=realloc(targets,(size_t)cap*sizeof(*targets));
+                        }
+                        for(int i=0;i<cols;i++) go[(size_t)states*cols+i]=-1;
+                        targets[states]=0;
+                        go[edge]=states++;
+                    }
+                    grown=realloc(grown,(size_t)(grown_count+1)*sizeof(*grown));
+                    grown[grown_count++]=go[edge];
+                }
+            }
+            int *swap=front;
+            front=grown;
+            grown=swap;
+            front_count=grown_count;
+        }
+        for(int f=0;f<front_count;f++) targets[front[f]]|=m->targets;
+    }
+    free(front);
+    free(grown);
+    // Failure links in BFS order turn the trie into a complete DFA.
+    int *fail=calloc((size_t)states,sizeof(*fail));
+    int *queue=malloc((size_t)states*sizeof(*queue));
+    int head=0,tail=0;
+    for(int c=0;c<cols;c++)
+    {
+        int *edge=&go[c];
+        if(*edge<0) *edge=0;
+        else
+        {
+            fail[*edge]=0;
+            queue[tail++]=*edge;
+        }
+    }
+    while(head<tail)
+    {
+        int s=queue[head++];
+        targets[s]|=targets[fail[s]];
+        for(int c=0;c<cols;c++)
+        {
+            int *edge=&go[(size_t)s*cols+c];
+            int via=go[(size_t)fail[s]*cols+c];
+            if(*edge<0) *edge=via;
+            else
+            {
+                fail[*edge]=via;
+                queue[tail++]=*edge;
+            }
+        }
+    }
+    free(fail);
+    free(queue);
+    const char *type=states<=0xffff ? "uint16_t" : "uint32_t";
+    fprintf(out,"// Content routing: Aho-Corasick automaton over byte classes.\n");
+    fprintf(out,"#define RULES_MATCH_COUNT %d\n",rs->match_count);
+    fprintf(out,"#define RULES_MATCH_STATES %d\n",states);
+    fprintf(out,"#define RULES_MATCH_CLASSES %d\n",cols);
+    fprintf(out,"#define RULES_MATCH_START %d\n",start);
+    fprintf(out,"static const uint8_t rules_match_class[256]={");
+    for(int c=0;c<256;c++) fprintf(out,"%s%d",c ? "," : "",cls[c]);
+    fprintf(out,"};\n");
+    fprintf(out,"static const %s rules_match_next[RULES_MATCH_STATES][RULES_MATCH_CLASSES]={\n",type);
+    for(int s=0;s<states;s++)
+    {
+        fprintf(out,"    {");
+        for(int c=0;c<cols;c++) fprintf(out,"%s%d",c ? "," : "",go[(size_t)s*cols+c]);
+        fprintf(out,"},\n");
+    }
+    fprintf(out,"};\n");
+    fprintf(out,"static const uint64_t rules_match_targets[RULES_MATCH_STATES]={");
+    for(int s=0;s<states;s++) fprintf(out,"%s0x%llxull",s ? "," : "",(unsigned long long)targets[s]);
+    fprintf(out,"};\n\n");
+    free(go);
+    free(targets);
+}
+static int caps_subset(const RuleDoer *a,const RuleDoer *b)
+{
+    for(int i=0;i<a->cap_count;i++)
+    {
+        int found=0;
+        for(int k=0;k<b->cap_count&&!found;k++) found=a->caps[i]==b->caps[k];
+        if(!found) return 0;
+    }
+    return 1;
+}
+// Fusion: next[x] = y for every forward edge x→y that can skip the inbox.
+static int *fuse_chains(const RuleSet *rs)
+{
+    int n=rs->doer_count;
+    int *next=malloc((size_t)n*sizeof(*next));
+    int *producers=calloc((size_t)n,sizeof(*producers));
+    int *state=calloc((size_t)n,sizeof(*state));
+    int *path=malloc((size_t)n*sizeof(*path));
+    for(int x=0;x<n;x++)
+    {
+        const RuleDoer *d=&rs->doers[x];
+        next[x]=-1;
+        if(d->forward<0) continue;
+        const RuleTarget *t=&rs->targets[d->forward];
+        if(t->pool>=0||t->doer_count!=1) continue;
+        int y=t->doers[0];
+        const RuleDoer *e=&rs->doers[y];
+        producers[y]++;
+        if(d->affinity<0||d->affinity!=e->affinity) continue;
+        if(!caps_subset(d,e)||(d->kind_mask&~e->kind_mask)||e->blocking_mask) continue;
+        next[x]=y;
+    }
+    for(int x=0;x<n;x++)
+    {
+        if(next[x]>=0&&producers[next[x]]!=1) next[x]=-1;
+    }
+    // Break cycles: a fused cycle would never return to the scheduler.
+    for(int s=0;s<n;s++)
+    {
+        int len=0,v=s;
+        while(v>=0&&state[v]==0)
+        {
+            state[v]=1;
+            path[len++]=v;
+            v=next[v];
+        }
+        if(v>=0&&state[v]==1)
+        {
+            for(int i=len-1;i>=0;i--)
+            {
+                int c=path[i];
+                next[c]=-1;
+                if(c==v) break;
+            }
+        }
+        for(int i=0;i<len;i++) state[path[i]]=2;
+    }
+    free(producers);
+    free(state);
+    free(path);
+    return next;
+}
+static void emit_header(const RuleSet *rs,FILE *out)
+{
+    char up[CMRC_NAME_LEN+1];
+    // Capability slots: doers first, then one template slot per pool.
+    int slots=rs->doer_count+rs->pool_count;
+    int words=(slots+63)/64;
+    fprintf(out,"/* Generated by cmrc from %s. Do not edit. */\n",g_path);
+    fprintf(out,"#ifndef SCAT10_RULES_H\n#define SCAT10_RULES_H\n#include <stdint.h>\n\n");
+    fprintf(out,"#define RULES_DOER_COUNT %d\n",rs->doer_count);
+    fprintf(out,"#define RULES_POOL_COUNT %d\n",rs->pool_count);
+    fprintf(out,"#define RULES_CAP_LIMIT %d\n",rs->cap_max+1);
+    fprintf(out,"#define RULES_DOER_WORDS %d\n\n",words);
+    fprintf(out,"typedef enum{\n");
+    for(int i=0;i<rs->target_count;i++)
+    {
+        upper(up,rs->targets[i].name);
+        fprintf(out,"    TARGET_%s,\n",up);
+    }
+    fprintf(out,"    TARGET_COUNT\n}Target;\n");
+    fprintf(out,"static const char *const rules_target_names[TARGET_COUNT]={");
+    for(int i=0;i<rs->target_count;i++)
+        fprintf(out,"%s\"%s\"",i ? "," : "",rs->targets[i].name);
+    fprintf(out,"};\n\n");
+    fprintf(out,"typedef enum{\n");
+    for(int i=0;i<rs->kind_count;i++)
+    {
+        upper(up,rs->kinds[i]);
+        fprintf(out,"    MSGK_%s,\n",up);
+    }
+    fprintf(out,"    MSGK_COUNT\n}MessageKind;\n");
+    fprintf(out,"static const char *const rules_kind_names[MSGK_COUNT]={");
+    for(int i=0;i<rs->kind_count;i++)
+        fprintf(out,"%s\"%s\"",i ? "," : "",rs->kinds[i]);
+    fprintf(out,"};\n\n");
+    // X(slot, name)
+    fprintf(out,"#define RULES_DOERS(X) \\\n");
+    for(int i=0;i<rs->doer_count;i++)
+    {
+        fprintf(out,"    X(%d,\"%s\")%s\n",i,rs->doers[i].name,i+1<rs->doer_count ? " \\" : "");
+    }
+    // X(pool, name, cap_slot)
+    fprintf(out,"\n#define RULES_POOLS(X)%s\n",rs->pool_count ? " \\" : "");
+    for(int i=0;i<rs->pool_count;i++)
+    {
+        fprintf(out,"    X(%d,\"%s\",%d)%s\n",i,rs->pools[i].name,
+                rs->doer_count+i,i+1<rs->pool_count ? " \\" : "");
+    }
+    // X(cap_slot, kind, handler): one entry per (doer or pool, kind).
+    fprintf(out,"\n#define RULES_HANDLERS(X) \\\n");
+    for(int i=0;i<slots;i++)
+    {
+        const RuleDoer *d=i<rs->doer_count ? &rs->doers[i] : &rs->pools[i-rs->doer_count];
+        for(int k=0;k<d->on_count;k++)
+        {
+            upper(up,rs->kinds[d->on[k].kind]);
+            fprintf(out,"    X(%d,MSGK_%s,%s)%s\n",i,up,d->on[k].func,
+                    i+1<slots||k+1<d->on_count ? " \\" : "");
+        }
+    }
+    fprintf(out,"\nstatic const uint32_t rules_kind_mask[%d]={",slots);
+    for(int i=0;i<slots;i++)
+    {
+        const RuleDoer *d=i<rs->doer_count ? &rs->doers[i] : &rs->pools[i-rs->doer_count];
+        fprintf(out,"%s0x%x",i ? "," : "",d->kind_mask);
+    }
+    fprintf(out,"};\n");
+    fprintf(out,"static const int32_t rules_forward[%d]={",slots);
+    for(int i=0;i<slots;i++)
+    {
+        const RuleDoer *d=i<rs->doer_count ? &rs->doers[i] : &rs->pools[i-rs->doer_count];
+        fprintf(out,"%s%d",i ? "," : "",d->forward);
+    }
+    fprintf(out,"};\n");
+    fprintf(out,"static const int32_t rules_inbox_high[%d]={",slots);
+    for(int i=0;i<slots;i++)
+    {
+        const RuleDoer *d=i<rs->doer_count ? &rs->doers[i] : &rs->pools[i-rs->doer_count];
+        fprintf(out,"%s%d",i ? "," : "",d->inbox_high);
+    }
+    fprintf(out,"};\n");
+    fprintf(out,"static const int32_t rules_inbox_low[%d]={",slots);
+    for(int i=0;i<slots;i++)
+    {
+        const RuleDoer *d=i<rs->doer_count ? &rs->doers[i] : &rs->pools[i-rs->doer_count];
+        fprintf(out,"%s%d",i ? "," : "",d->inbox_low);
+    }
+    fprintf(out,"};\n");
+    int blocking=0;
+    fprintf(out,"static const uint32_t rules_blocking_kinds[%d]={",slots);
+    for(int i=0;i<slots;i++)
+    {
+        const RuleDoer *d=i<rs->doer_count ? &rs->doers[i] : &rs->pools[i-rs->doer_count];
+        fprintf(out,"%s0x%x",i ? "," : "",d->blocking_mask);
+        blocking|=d->blocking_mask!=0;
+    }
+    fprintf(out,"};\n");
+    fprintf(out,"#define RULES_HAS_BLOCKING %d\n",blocking);
+    fprintf(out,"static const uint32_t rules_coalesce_kinds[%d]={",slots);
+    for(int i=0;i<slots;i++)
+    {
+        const RuleDoer *d=i<rs->doer_count ? &rs->doers[i] : &rs->pools[i-rs->doer_count];
+        fprintf(out,"%s0x%x",i ? "," : "",d->coalesce_mask);
+    }
+    fprintf(out,"};\n");
+    // Affinity: declared groups first, then one group per ungrouped doer.
+    int affinity=rs->affinity_count;
+    fprintf(out,"static const int32_t rules_doer_affinity[RULES_DOER_COUNT]={");
+    for(int i=0;i<rs->doer_count;i++)
+    {
+        int a=rs->doers[i].affinity>=0 ? rs->doers[i].affinity : affinity++;
+        fprintf(out,"%s%d",i ? "," : "",a);
+    }
+    fprintf(out,"};\n");
+    fprintf(out,"#define RULES_AFFINITY_COUNT %d\n",affinity);
+    int *fused=fuse_chains(rs);
+    fprintf(out,"static const int32_t rules_fused_next[RULES_DOER_COUNT]={");
+    for(int i=0;i<rs->doer_count;i++)
+        fprintf(out,"%s%d",i ? "," : "",fused[i]);
+    fprintf(out,"};\n");
+    free(fused);
+    upper(up,rs->targets[rs->stdin_target].name);
+    fprintf(out,"\n#define RULES_STDIN_TARGET TARGET_%s\n",up);
+    fprintf(out,"#define RULES_STDIN_CAP %d\n",rs->stdin_cap);
+    upper(up,rs->kinds[rs->stdin_kind]);
+    fprintf(out,"#define RULES_STDIN_KIND MSGK_%s\n\n",up);
+    emit_matcher(rs,out);
+
+    // Topics: subscribing to one requires holding its capability.
+    fprintf(out,"typedef enum{\n");
+    for(int i=0;i<rs->topic_count;i++)
+    {
+        upper(up,rs->topics[i].name);
+        fprintf(out,"    TOPIC_%s,\n",up);
+    }
+    fprintf(out,"    TOPIC_COUNT\n}Topic;\n");
+    fprintf(out,"static const char *const rules_topic_names[%d]={",rs->topic_count ? rs->topic_count : 1);
+    for(int i=0;i<rs->topic_count;i++)
+        fprintf(out,"%s\"%s\"",i ? "," : "",rs->topics[i].name);
+    fprintf(out,"%s};\n",rs->topic_count ? "" : "0");
+    fprintf(out,"static const int32_t rules_topic_cap[%d]={",rs->topic_count ? rs->topic_count : 1);
+    for(int i=0;i<rs->topic_count;i++)
+        fprintf(out,"%s%d",i ? "," : "",rs->topics[i].cap);
+    fprintf(out,"%s};\n\n",rs->topic_count ? "" : "0");
+    emit_verbs(rs,out);
+
+    // Validation image: one doer bitmap per capability.
+    uint64_t *bits=calloc((size_t)(rs->cap_max+1)*words,sizeof(*bits));
+    for(int i=0;i<slots;i++)
+    {
+        const RuleDoer *d=i<rs->doer_count ? &rs->doers[i] : &rs->pools[i-rs->doer_count];
+        for(int c=0;c<d->cap_count;c++)
+        {
+            bits[(size_t)d->caps[c]*words+i/64]|=1ull<<(i%64);
+        }
+    }
+    fprintf(out,"static const uint64_t rules_cap_doers[RULES_CAP_LIMIT][RULES_DOER_WORDS]={\n");
+    for(int c=0;c<=rs->cap_max;c++)
+    {
+        fprintf(out,"    {");
+        for(int w=0;w<words;w++)
+            fprintf(out,"%s0x%llxull",w ? "," : "",(unsigned long long)bits[(size_t)c*words+w]);
+        fprintf(out,"},\n");
+    }
+    fprintf(out,"};\n\n");
+    free(bits);
+
+    // Routing image: CSR layout, target → [doer slots].
+    fprintf(out,"static const uint32_t rules_route_offset[TARGET_COUNT+1]={");
+    int off=0;
+    for(int i=0;i<=rs->target_count;i++)
+    {
+        fprintf(out,"%s%d",i ? "," : "",off);
+        if(i<rs->target_count) off+=rs->targets[i].doer_count;
+    }
+    fprintf(out,"};\n");
+    fprintf(out,"static const uint32_t rules_route_doers[%d]={",off ? off : 1);
+    int first=1;
+    for(int i=0;i<rs->target_count;i++)
+    {
+        for(int k=0;k<rs->targets[i].doer_count;k++)
+        {
+            fprintf(out,"%s%d",first ? "" : ",",rs->targets[i].doers[k]);
+            first=0;
+        }
+    }
+    fprintf(out,"%s};\n\n",off ? "" : "0");
+
+    // Multicast image: every target with more than one doer is a group,
+    // stored as a doer-slot bitmap so validation against a capability is
+    // one AND with rules_cap_doers[cap] per 64 members.
+    fprintf(out,"static const int32_t rules_route_pool[TARGET_COUNT]={");
+    for(int i=0;i<rs->target_count;i++)
+    {
+        fprintf(out,"%s%d",i ? "," : "",rs->targets[i].pool);
+    }
+    fprintf(out,"};\n");
+    int groups=0;
+    fprintf(out,"static const int32_t rules_route_group[TARGET_COUNT]={");
+    for(int i=0;i<rs->target_count;i++)
+    {
+        fprintf(out,"%s%d",i ? "," : "",rs->targets[i].doer_count>1 ? groups++ : -1);
+    }
+    fprintf(out,"};\n");
+    fprintf(out,"#define RULES_GROUP_COUNT %d\n",groups);
+    fprintf(out,"static const uint64_t rules_group_members[%d][RULES_DOER_WORDS]={\n",groups ? groups : 1);
+    uint64_t *row=malloc((size_t)words*sizeof(*row));
+    for(int i=0;i<rs->target_count;i++)
+    {
+        if(rs->targets[i].doer_count<2) continue;
+        memset(row,0,(size_t)words*sizeof(*row));
+        for(int k=0;k<rs->targets[i].doer_count;k++)
+            row[rs->targets[i].doers[k]/64]|=1ull<<(rs->targets[i].doers[k]%64);
+        fprintf(out,"    {");
+        for(int w=0;w<words;w++)
+            fprintf(out,"%s0x%llxull",w ? "," : "",(unsigned long long)row[w]);
+        fprintf(out,"},\n");
+    }
+    free(row);
+    fprintf(out,"%s};\n\n#endif\n",groups ? "" : "    {0}\n");
+}
+int main(int argc,char **argv)
+{
+    if(argc!=2)
+    {
+        fprintf(stderr,"usage: %s RULE-FILE > scat10_rules.h\n",argv[0]);
+        return 2;
+    }
+    g_path=argv[1];
+    FILE *in=fopen(g_path,"r");
+    if(!in)
+    {
+        perror(g_path);
+        return 1;
+    }
+    RuleSet rs={0};
+    parse_rules(&rs,in);
+    fclose(in);
+    emit_header(&rs,stdout);
+    return 0;
+}
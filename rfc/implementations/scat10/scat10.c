@@ -10,7 +10,8 @@
  * 3. Message balance must close to zero
  *
  * This file intentionally avoids:
- * - threads
+ * - threads by default (-w adds workers, see WORKERS; the metrics
+ *   side thread only reads counters)
  * - locks
  * - time slicing
  *
@@ -22,38 +23,74 @@
  * to observe capability flow and enforcement behavior.
  * This will be sealed in a later phase.
  */
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <endian.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/perf_event.h>
+// Design-time rules: generated by cmrc from scat10.rules.
+#include "scat10_rules.h"
 
-static unsigned long g_msg_created  = 0;
-static unsigned long g_msg_enqueued = 0;
-static unsigned long g_msg_handled  = 0;
-static unsigned long g_msg_dropped  = 0;
-// === MINT ===
-// Responsible for creating unique message/capability identities.
-static int mint_msg_id=0;
-static int mint_cap_id=0;
+// Counters have a single writer; the metrics thread only loads them.
+// A relaxed load+store keeps the hot path free of locked
+// read-modify-write instructions. A runtime's totals are sharded:
+// every worker thread owns one shard and readers sum them.
+typedef _Atomic unsigned long Counter;
+static inline void counter_add(Counter *c,unsigned long n)
+{
+    atomic_store_explicit(c,atomic_load_explicit(c,memory_order_relaxed)+n,memory_order_relaxed);
+}
+static inline unsigned long counter_get(Counter *c)
+{
+    return atomic_load_explicit(c,memory_order_relaxed);
+}
+#define MAX_WORKERS 64
+typedef struct{
+    _Alignas(64) Counter created;
+    Counter enqueued;
+    Counter handled;
+    Counter dropped;
+    // Payload bytes referenced by enqueued deliveries (admission
+    // control). Added by the producer's shard, removed by the
+    // consumer's, so only the sum is meaningful.
+    Counter inflight_bytes;
+    Counter rejected;   // refused by admission control
+}CounterShard;
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000000u+(uint64_t)ts.tv_nsec;
+}
 
-typedef enum{
-    CMD_SEND_A,
-    CMD_SEND_B,
-    CMD_SEND_BOTH,
-    CMD_EXIT,
-    CMD_UNKNOWN
-}CommandType;
-typedef struct Command{
-    CommandType type;
-    char *text;
-}Command;
-typedef enum{
-    TARGET_A,
-    TARGET_B,
-    TARGET_BOTH
-}Target;
-typedef enum{
-    MSGK_APP,
-    MSGK_STDIN_LINE
-}MessageKind;
 typedef struct{
     int id;
     int cap;
@@ -61,213 +98,1098 @@ typedef struct{
     Target to;
     char *payload;
 }Message;
-typedef struct{
-    int allowed_caps[4];
-    int cap_count;
-}CapabilitySet;
-static Command parse_command(char *line)
+// === BOUNDARY DECODER ===
+// Turns one input line straight into a Message:
+//   VERB TEXT  → Message to the verb's target (verbs are the compiled,
+//                lower-cased target names)
+//   exit       → control: stop reading input
+//   grant CAP NAME, revoke CAP NAME → control: change a capability set
+//                (payload points at "CAP NAME")
+//   subscribe TOPIC NAME, unsubscribe TOPIC NAME, publish TOPIC TEXT
+//              → control: topic membership and publishing (payload
+//                points at the arguments)
+//   other text → Message routed by content (the rule file's match
+//                rules), to the stdin boundary target if none matches
+//   VERB alone, or exit with arguments → rejected as malformed
+//   blank line → no-op
+// Verb lookup is one perfect-hash probe on the first 8 bytes;
+// field splitting scans 8 bytes per step.
+// Target of a Message routed by its payload (runtime_route_content).
+#define TARGET_BY_CONTENT ((Target)TARGET_COUNT)
+typedef enum{
+    C2M_OK,
+    C2M_CTRL_EXIT,
+    C2M_CTRL_GRANT,
+    C2M_CTRL_REVOKE,
+    C2M_CTRL_SUBSCRIBE,
+    C2M_CTRL_UNSUBSCRIBE,
+    C2M_CTRL_PUBLISH,
+    C2M_NOOP,
+    C2M_REJECT
+}C2MResult;
+#define SWAR_ONES  0x0101010101010101ull
+#define SWAR_HIGHS 0x8080808080808080ull
+#if defined(__BYTE_ORDER__)&&__BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+#define BOUNDARY_SWAR 1
+#else
+#define BOUNDARY_SWAR 0
+#endif
+// Nonzero iff some byte of x equals c; the lowest flagged byte is exact.
+static inline uint64_t swar_has_byte(uint64_t x,unsigned char c)
+{
+    uint64_t y=x^(SWAR_ONES*c);
+    return (y-SWAR_ONES)&~y&SWAR_HIGHS;
+}
+// Index of the first blank (space or tab) in p[0..n), or n.
+static size_t boundary_field_end(const char *p,size_t n)
 {
-    Command cmd={.type=CMD_UNKNOWN,.text=NULL};
-    while(*line==' '||*line=='\t'){line++;}
-    if(line[0]=='\0')return cmd;
-    if(strcmp(line,"exit")==0)
+    size_t i=0;
+#if BOUNDARY_SWAR
+    for(;i+8<=n;i+=8)
     {
-        cmd.type=CMD_EXIT;
-        return cmd;
+        uint64_t x;
+        memcpy(&x,p+i,8);
+        uint64_t m=swar_has_byte(x,' ')|swar_has_byte(x,'\t');
+        if(m) return i+((size_t)__builtin_ctzll(m)>>3);
     }
-    if(strncmp(line,"a ",2)==0)
+#endif
+    for(;i<n;i++)
     {
-        cmd.type=CMD_SEND_A;
-        cmd.text=line+2;
-        return cmd;
+        if(p[i]==' '||p[i]=='\t') return i;
     }
-    if(strncmp(line,"b ",2)==0)
+    return n;
+}
+// First (up to) 8 bytes of p as a little-endian word, zero padded.
+// avail is how many bytes may be read from p.
+static uint64_t verb_prefix(const char *p,size_t len,size_t avail)
+{
+    uint64_t v=0;
+#if BOUNDARY_SWAR
+    if(avail>=8)
     {
-        cmd.type=CMD_SEND_B;
-        cmd.text=line+2;
-        return cmd;
+        memcpy(&v,p,8);
+        return len>=8 ? v : v&((1ull<<(8*len))-1);
     }
-    if(strncmp(line,"both ",5)==0)
+#endif
+    (void)avail;
+    for(size_t i=0;i<len&&i<8;i++) v|=(uint64_t)(unsigned char)p[i]<<(8*i);
+    return v;
+}
+static const RulesVerb *boundary_lookup(const char *p,size_t len,size_t avail)
+{
+    uint64_t prefix=verb_prefix(p,len,avail);
+    const RulesVerb *v=&rules_verbs[((prefix^len)*RULES_VERB_MUL)>>(64-RULES_VERB_BITS)];
+    if(v->len!=len||v->prefix!=prefix) return NULL;
+    if(len>8&&memcmp(p+8,v->verb+8,len-8)!=0) return NULL;
+    return v;
+}
+static C2MResult boundary_decode(char *line,size_t n,Message *out)
+{
+    size_t i=0;
+    while(i<n&&(line[i]==' '||line[i]=='\t')) i++;
+    if(i==n) return C2M_NOOP;
+    char *p=line+i;
+    n-=i;
+    size_t vlen=boundary_field_end(p,n);
+    const RulesVerb *v=boundary_lookup(p,vlen,n);
+    out->kind=RULES_STDIN_KIND;
+    out->cap=RULES_STDIN_CAP;
+    if(!v)
     {
-        cmd.type=CMD_SEND_BOTH;
-        cmd.text=line+5;
-        return cmd;
+        out->to=RULES_MATCH_COUNT ? TARGET_BY_CONTENT : RULES_STDIN_TARGET;
+        out->payload=p;
+        return C2M_OK;
     }
-    return cmd;
+    size_t j=vlen;
+    while(j<n&&(p[j]==' '||p[j]=='\t')) j++;
+    if(v->target==RULES_VERB_EXIT) return j==n ? C2M_CTRL_EXIT : C2M_REJECT;
+    if(j==n) return C2M_REJECT;
+    out->payload=p+j;
+    if(v->target==RULES_VERB_GRANT) return C2M_CTRL_GRANT;
+    if(v->target==RULES_VERB_REVOKE) return C2M_CTRL_REVOKE;
+    if(v->target==RULES_VERB_SUBSCRIBE) return C2M_CTRL_SUBSCRIBE;
+    if(v->target==RULES_VERB_UNSUBSCRIBE) return C2M_CTRL_UNSUBSCRIBE;
+    if(v->target==RULES_VERB_PUBLISH) return C2M_CTRL_PUBLISH;
+    out->to=(Target)v->target;
+    return C2M_OK;
 }
-typedef enum{
-    C2M_OK,
-    C2M_CTRL_EXIT,
-    C2M_NOOP
-}C2MResult;
-C2MResult command_to_message(Command *cmd,Message *msg)
-{
-    switch(cmd->type){
-        case CMD_SEND_A:
-            msg->to=TARGET_A;
-            msg->payload=cmd->text;
-            //g_msg_created++;
-            return C2M_OK;
-        case CMD_SEND_B:
-            msg->to=TARGET_B;
-            msg->payload=cmd->text;
-            //g_msg_created++;
-            return C2M_OK;
-        case CMD_SEND_BOTH:
-            msg->to=TARGET_BOTH;
-            msg->payload=cmd->text;
-            //g_msg_created++;
-            return C2M_OK;
-        case CMD_EXIT:
-            return C2M_CTRL_EXIT;
-        case CMD_UNKNOWN:
-        default:
-            return C2M_NOOP;
-    }
-}
-#define INBOX_CAP 16
-typedef struct{
-    Message msgs[INBOX_CAP];
+// === COALESCING ===
+// Kinds a Doer takes latest-value-wins ("coalesce" in the rule file)
+// are keyed by kind and the first word of the payload: "cpu 93" and
+// "cpu 12" share a key. A delivery whose key is still queued in the
+// Doer's inbox takes over that slot, and the Message it replaces is
+// dropped as superseded, so a burst of N updates costs one handler
+// call. Deliveries from another worker coalesce when the owner moves
+// them from its remote ring into the inbox.
+static uint64_t coalesce_key(const Message *m)
+{
+    uint64_t h=(1469598103934665603ull^(uint64_t)m->kind)*1099511628211ull;
+    for(const char *p=m->payload;p&&*p&&*p!=' ';p++)
+        h=(h^(unsigned char)*p)*1099511628211ull;
+    return h;
+}
+static int coalesce_same_key(const Message *a,const Message *b)
+{
+    const char *p=a->payload ? a->payload : "";
+    const char *q=b->payload ? b->payload : "";
+    size_t n=strcspn(p," ");
+    return a->kind==b->kind&&strcspn(q," ")==n&&memcmp(p,q,n)==0;
+}
+// === ENVELOPE ===
+// Shared, reference-counted Message body. An inbox slot holds only a
+// pointer to it plus its own delivery id, so a multicast enqueues the
+// same Envelope into every target inbox instead of copying the Message.
+// The creator holds one reference until it has delivered to everyone;
+// each inbox slot holds another. References are atomic because a
+// multicast can reach Doers on several workers. Free lists are per
+// thread: an Envelope returns to the list of the thread releasing it,
+// and a thread that releases more than it allocates (a worker draining
+// what the main thread or another worker created) hands the surplus
+// to a locked shared list, which a thread runs to before it mallocs.
+typedef struct Envelope{
+    Message msg;
+    uint32_t payload_len;
+    _Atomic int refs;
+    struct Envelope *next_free;
+}Envelope;
+#define ENVELOPE_CHUNK 256
+#define ENVELOPE_CACHE (4*ENVELOPE_CHUNK)
+static pthread_mutex_t g_envelope_lock=PTHREAD_MUTEX_INITIALIZER;
+static Envelope *g_envelope_shared=NULL;
+static int g_envelope_shared_count=0;
+static _Thread_local Envelope *g_envelope_free=NULL;
+static _Thread_local int t_envelope_free_count=0;
+static Envelope *envelope_alloc(const Message *m)
+{
+    if(!g_envelope_free)
+    {
+        pthread_mutex_lock(&g_envelope_lock);
+        g_envelope_free=g_envelope_shared;
+        t_envelope_free_count=g_envelope_shared_count;
+        g_envelope_shared=NULL;
+        g_envelope_shared_count=0;
+        pthread_mutex_unlock(&g_envelope_lock);
+    }
+    if(!g_envelope_free)
+    {
+        Envelope *chunk=malloc(ENVELOPE_CHUNK*sizeof(*chunk));
+        if(!chunk)
+        {
+            perror("malloc");
+            exit(1);
+        }
+        for(int i=0;i<ENVELOPE_CHUNK;i++)
+        {
+            chunk[i].next_free=g_envelope_free;
+            g_envelope_free=&chunk[i];
+        }
+        t_envelope_free_count=ENVELOPE_CHUNK;
+    }
+    Envelope *e=g_envelope_free;
+    g_envelope_free=e->next_free;
+    t_envelope_free_count--;
+    e->msg=*m;
+    e->payload_len=m->payload ? (uint32_t)strlen(m->payload) : 0;
+    atomic_init(&e->refs,1);
+    return e;
+}
+// Keeps the newest ENVELOPE_CHUNK, moves the rest to the shared list.
+static void envelope_spill(void)
+{
+    Envelope *cut=g_envelope_free;
+    for(int i=1;i<ENVELOPE_CHUNK;i++) cut=cut->next_free;
+    Envelope *rest=cut->next_free,*tail=rest;
+    cut->next_free=NULL;
+    while(tail->next_free) tail=tail->next_free;
+    pthread_mutex_lock(&g_envelope_lock);
+    tail->next_free=g_envelope_shared;
+    g_envelope_shared=rest;
+    g_envelope_shared_count+=t_envelope_free_count-ENVELOPE_CHUNK;
+    pthread_mutex_unlock(&g_envelope_lock);
+    t_envelope_free_count=ENVELOPE_CHUNK;
+}
+// Returns the Envelope to the pool once no one references it.
+static void envelope_release(Envelope *e)
+{
+    if(atomic_fetch_sub_explicit(&e->refs,1,memory_order_acq_rel)!=1) return;
+    e->next_free=g_envelope_free;
+    g_envelope_free=e;
+    if(++t_envelope_free_count>=ENVELOPE_CACHE) envelope_spill();
+}
+typedef struct{
+    Envelope *env;
+    int id;
+    uint64_t enq_ns;    // enqueue time, 0 unless metrics are enabled
+}InboxSlot;
+// An inbox keeps a few slots inline for the usual shallow queue; a
+// backlog spills into chained segments borrowed from a shared pool and
+// handed back as it drains, so memory follows the backlog.
+#define INBOX_INLINE 4
+#define INBOX_SEG_SLOTS 64
+#define INBOX_DEFAULT_HIGH 4096
+#define INBOX_DEFAULT_LOW INBOX_SEG_SLOTS
+#define INBOX_SEG_CACHE 8
+// Where a coalescing key was last queued. Direct-mapped by key hash: a
+// colliding key takes the entry over and the old one just stops
+// coalescing until it is queued again.
+#define INBOX_KEYS 64
+typedef struct{
+    uint64_t hash;
+    unsigned long seq;  // pushed count right after its push, 0: unused
+}InboxKey;
+typedef struct InboxSeg{
+    struct InboxSeg *next;
+    InboxSlot slots[INBOX_SEG_SLOTS];
+}InboxSeg;
+// Free segments: a short per-thread list in front of a locked shared one.
+static pthread_mutex_t g_seg_lock=PTHREAD_MUTEX_INITIALIZER;
+static InboxSeg *g_seg_free=NULL;
+static _Atomic unsigned long g_seg_allocated=0;
+static _Thread_local InboxSeg *t_seg_free=NULL;
+static _Thread_local int t_seg_free_count=0;
+static InboxSeg *seg_get(void)
+{
+    InboxSeg *s=t_seg_free;
+    if(s)
+    {
+        t_seg_free=s->next;
+        t_seg_free_count--;
+        return s;
+    }
+    pthread_mutex_lock(&g_seg_lock);
+    s=g_seg_free;
+    if(s) g_seg_free=s->next;
+    pthread_mutex_unlock(&g_seg_lock);
+    if(s) return s;
+    s=malloc(sizeof(*s));
+    if(!s)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    atomic_fetch_add_explicit(&g_seg_allocated,1,memory_order_relaxed);
+    return s;
+}
+static void seg_put(InboxSeg *s)
+{
+    if(t_seg_free_count<INBOX_SEG_CACHE)
+    {
+        s->next=t_seg_free;
+        t_seg_free=s;
+        t_seg_free_count++;
+        return;
+    }
+    pthread_mutex_lock(&g_seg_lock);
+    s->next=g_seg_free;
+    g_seg_free=s;
+    pthread_mutex_unlock(&g_seg_lock);
+}
+typedef struct{
+    InboxSlot ring[INBOX_INLINE];   // oldest Messages while nothing spilled
     int head;
-    int tail;
+    int len;
+    InboxSeg *first;    // spilled Messages, oldest segment first
+    InboxSeg *last;
+    int first_pos;      // next slot to pop in first
+    int last_pos;       // next slot to fill in last
+    InboxSeg *spare;    // an emptied segment kept while above low
+    int depth;
+    int high;           // more queued than this is refused (inbox_full)
+    int low;            // at or below this the spare segment goes back
+    // Shard of the enqueue/dequeue counters; depth for the metrics
+    // thread is pushed-popped, the rest stays scheduler-private.
+    Counter pushed;
+    Counter popped;
+    Counter segments;   // segments held, spare included
+    InboxKey *keys;     // INBOX_KEYS entries, from the first coalescing push
 }Inbox;
-static void inbox_init(Inbox *q)
+static void inbox_init(Inbox *q,int high,int low)
 {
-    q->head=q->tail=0;
+    q->head=q->len=0;
+    q->first=q->last=q->spare=NULL;
+    q->first_pos=q->last_pos=0;
+    q->depth=0;
+    q->keys=NULL;
+    q->high=high>0 ? high : INBOX_DEFAULT_HIGH;
+    q->low=low>0 ? low : INBOX_DEFAULT_LOW;
+    if(q->low>=q->high) q->low=q->high-1;
 }
 static int inbox_empty(Inbox *q)
 {
-    return q->head==q->tail;
+    return q->depth==0;
 }
-static int inbox_full(Inbox *q)
+static int inbox_depth(const Inbox *q)
 {
-    return ((q->tail+1)%INBOX_CAP)==q->head;
+    return q->depth;
 }
-static int inbox_push(Inbox *q,const Message *m)
+static InboxSlot *inbox_tail_slot(Inbox *q)
 {
-    if(inbox_full(q)) return -1;
-    q->msgs[q->tail]=*m;
-    q->tail=((q->tail+1)%INBOX_CAP);
-    g_msg_enqueued++;
+    if(!q->first&&q->len<INBOX_INLINE) return &q->ring[(q->head+q->len++)%INBOX_INLINE];
+    if(!q->last||q->last_pos==INBOX_SEG_SLOTS)
+    {
+        InboxSeg *s=q->spare;
+        if(s)
+        {
+            q->spare=NULL;
+        }
+        else
+        {
+            s=seg_get();
+            counter_add(&q->segments,1);
+        }
+        s->next=NULL;
+        if(q->last) q->last->next=s;
+        else q->first=s,q->first_pos=0;
+        q->last=s;
+        q->last_pos=0;
+    }
+    return &q->last->slots[q->last_pos++];
+}
+static const InboxSlot *inbox_front(const Inbox *q)
+{
+    return q->len ? &q->ring[q->head] : &q->first->slots[q->first_pos];
+}
+static void inbox_seg_release(Inbox *q,InboxSeg *s)
+{
+    if(!q->spare&&q->depth>q->low)
+    {
+        q->spare=s;
+        return;
+    }
+    seg_put(s);
+    counter_add(&q->segments,-1UL);
+}
+static void inbox_advance(Inbox *q)
+{
+    q->depth--;
+    if(q->len)
+    {
+        q->head=(q->head+1)%INBOX_INLINE;
+        q->len--;
+    }
+    else if(++q->first_pos==INBOX_SEG_SLOTS||(q->first==q->last&&q->first_pos==q->last_pos))
+    {
+        InboxSeg *s=q->first;
+        q->first=s->next;
+        q->first_pos=0;
+        if(!q->first) q->last=NULL;
+        inbox_seg_release(q,s);
+    }
+    if(q->spare&&q->depth<=q->low)
+    {
+        seg_put(q->spare);
+        q->spare=NULL;
+        counter_add(&q->segments,-1UL);
+    }
+}
+// Inboxes only queue; the runtime accounts for what goes through them
+// (doer_deliver, doer_take).
+static int inbox_push_shared(Inbox *q,Envelope *e,int id,uint64_t enq_ns)
+{
+    if(q->depth>=q->high) return -1;
+    InboxSlot *s=inbox_tail_slot(q);
+    s->env=e;
+    s->id=id;
+    s->enq_ns=enq_ns;
+    q->depth++;
+    atomic_fetch_add_explicit(&e->refs,1,memory_order_relaxed);
+    counter_add(&q->pushed,1);
+    return 0;
+}
+// Slot i of the queue, counting from the oldest Message.
+static const InboxSlot *inbox_slot(const Inbox *q,int i)
+{
+    if(i<q->len) return &q->ring[(q->head+i)%INBOX_INLINE];
+    i+=q->first_pos-q->len;
+    const InboxSeg *s=q->first;
+    for(;i>=INBOX_SEG_SLOTS;i-=INBOX_SEG_SLOTS) s=s->next;
+    return &s->slots[i];
+}
+static void inbox_at(const Inbox *q,int i,Message *out)
+{
+    const InboxSlot *s=inbox_slot(q,i);
+    *out=s->env->msg;
+    out->id=s->id;
+}
+// Like inbox_push_shared, but e takes over the slot of a queued Message
+// with its key, whose contents move to *old. Returns 1 when it did, 0
+// for a plain push, -1 when full.
+static int inbox_push_coalesce(Inbox *q,Envelope *e,int id,uint64_t enq_ns,InboxSlot *old)
+{
+    if(!q->keys&&!(q->keys=calloc(INBOX_KEYS,sizeof(*q->keys))))
+    {
+        perror("calloc");
+        exit(1);
+    }
+    uint64_t h=coalesce_key(&e->msg);
+    InboxKey *k=&q->keys[h%INBOX_KEYS];
+    unsigned long popped=counter_get(&q->popped);
+    if(k->hash==h&&k->seq>popped)
+    {
+        InboxSlot *s=(InboxSlot *)inbox_slot(q,(int)(k->seq-1-popped));
+        if(coalesce_same_key(&s->env->msg,&e->msg))
+        {
+            *old=*s;
+            s->env=e;
+            s->id=id;
+            s->enq_ns=enq_ns;
+            atomic_fetch_add_explicit(&e->refs,1,memory_order_relaxed);
+            return 1;
+        }
+    }
+    if(inbox_push_shared(q,e,id,enq_ns)!=0) return -1;
+    k->hash=h;
+    k->seq=counter_get(&q->pushed);
     return 0;
 }
-static int inbox_pop(Inbox *q,Message *out)
+// Hands the oldest slot, and its Envelope reference, to the caller.
+static int inbox_pop(Inbox *q,InboxSlot *out)
 {
     if(inbox_empty(q)) return -1;
-    *out=q->msgs[q->head];
-    q->head=((q->head+1)%INBOX_CAP);
+    *out=*inbox_front(q);
+    inbox_advance(q);
+    counter_add(&q->popped,1);
+    return 0;
+}
+// Releases everything still queued (runtime teardown).
+static void inbox_free(Inbox *q)
+{
+    InboxSlot s;
+    while(inbox_pop(q,&s)==0) envelope_release(s.env);
+    if(q->spare) seg_put(q->spare);
+    q->spare=NULL;
+    free(q->keys);
+    q->keys=NULL;
+}
+// Cross-worker inbox: a bounded multi-producer, single-consumer ring.
+// Producers claim a cell with one CAS on tail; each cell's sequence
+// number tells the owner worker when it is filled and producers when it
+// is free again. Only Messages leaving an affinity group pay for it.
+// The ring is only a hand-off: the owner moves what it finds into its
+// plain inbox (doer_collect_remote), which the watermark bounds. While
+// the ring is full, as when the owner is stuck in a long handler,
+// producers append to a locked spill list instead; once anything has
+// spilled, later deliveries spill too until the owner has taken the
+// list, so each producer's Messages stay in order.
+#define REMOTE_CAP 64
+typedef struct RemoteSpill{
+    struct RemoteSpill *next;
+    InboxSlot slot;
+}RemoteSpill;
+typedef struct{
+    _Atomic size_t seq;
+    Envelope *env;
+    int id;
+    uint64_t enq_ns;
+}RemoteCell;
+typedef struct{
+    RemoteCell cells[REMOTE_CAP];
+    _Alignas(64) _Atomic size_t tail;
+    _Alignas(64) _Atomic size_t head;
+    // Spill list, oldest first, under spill_lock. spilled counts it and
+    // is nonzero from the first spill until the owner takes the list.
+    _Alignas(64) pthread_mutex_t spill_lock;
+    RemoteSpill *spill;
+    RemoteSpill **spill_tail;
+    _Atomic size_t spilled;
+    RemoteSpill *taken;         // owner only: the list it took, not popped yet
+    _Atomic size_t taken_count;
+}RemoteInbox;
+static void remote_init(RemoteInbox *q)
+{
+    for(size_t i=0;i<REMOTE_CAP;i++) atomic_init(&q->cells[i].seq,i);
+    atomic_init(&q->tail,0);
+    atomic_init(&q->head,0);
+    pthread_mutex_init(&q->spill_lock,NULL);
+    q->spill=NULL;
+    q->spill_tail=&q->spill;
+    atomic_init(&q->spilled,0);
+    q->taken=NULL;
+    atomic_init(&q->taken_count,0);
+}
+static void remote_spill(RemoteInbox *q,Envelope *e,int id,uint64_t enq_ns)
+{
+    RemoteSpill *s=malloc(sizeof(*s));
+    if(!s)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    s->next=NULL;
+    s->slot=(InboxSlot){.env=e,.id=id,.enq_ns=enq_ns};
+    atomic_fetch_add_explicit(&e->refs,1,memory_order_relaxed);
+    pthread_mutex_lock(&q->spill_lock);
+    *q->spill_tail=s;
+    q->spill_tail=&s->next;
+    // seq_cst, like the CAS on tail: the owner's wake condition.
+    atomic_fetch_add_explicit(&q->spilled,1,memory_order_seq_cst);
+    pthread_mutex_unlock(&q->spill_lock);
+}
+// Never refuses: a full ring spills. The watermark is checked by the
+// caller against the Doer's whole depth.
+static void remote_push(RemoteInbox *q,Envelope *e,int id,uint64_t enq_ns)
+{
+    if(atomic_load_explicit(&q->spilled,memory_order_acquire))
+    {
+        remote_spill(q,e,id,enq_ns);
+        return;
+    }
+    size_t pos=atomic_load_explicit(&q->tail,memory_order_relaxed);
+    RemoteCell *c;
+    for(;;)
+    {
+        c=&q->cells[pos%REMOTE_CAP];
+        size_t seq=atomic_load_explicit(&c->seq,memory_order_acquire);
+        intptr_t dif=(intptr_t)seq-(intptr_t)pos;
+        if(dif==0)
+        {
+            // seq_cst: ordered before the push's check for a parked
+            // owner (IDLE), which rechecks tail after parking.
+            if(atomic_compare_exchange_weak_explicit(&q->tail,&pos,pos+1,
+                                                     memory_order_seq_cst,memory_order_relaxed))
+                break;
+        }
+        else if(dif<0)
+        {
+            remote_spill(q,e,id,enq_ns);
+            return;
+        }
+        else
+        {
+            pos=atomic_load_explicit(&q->tail,memory_order_relaxed);
+        }
+    }
+    c->env=e;
+    c->id=id;
+    c->enq_ns=enq_ns;
+    atomic_fetch_add_explicit(&e->refs,1,memory_order_relaxed);
+    atomic_store_explicit(&c->seq,pos+1,memory_order_release);
+}
+// Whether a producer has claimed a cell the owner has not popped yet
+// (possibly not filled yet), or spilled. Owner only.
+static int remote_claimed(RemoteInbox *q)
+{
+    return atomic_load(&q->tail)!=atomic_load_explicit(&q->head,memory_order_relaxed)
+           ||atomic_load(&q->spilled)||q->taken;
+}
+static int remote_empty(RemoteInbox *q)
+{
+    size_t head=atomic_load_explicit(&q->head,memory_order_relaxed);
+    return atomic_load_explicit(&q->cells[head%REMOTE_CAP].seq,memory_order_acquire)!=head+1
+           &&!atomic_load_explicit(&q->spilled,memory_order_relaxed)
+           &&!atomic_load_explicit(&q->taken_count,memory_order_relaxed);
+}
+static size_t remote_depth(RemoteInbox *q)
+{
+    size_t tail=atomic_load_explicit(&q->tail,memory_order_relaxed);
+    size_t head=atomic_load_explicit(&q->head,memory_order_relaxed);
+    return (tail>head ? tail-head : 0)+atomic_load_explicit(&q->spilled,memory_order_relaxed)
+           +atomic_load_explicit(&q->taken_count,memory_order_relaxed);
+}
+// Owner worker only; like inbox_pop, the Envelope reference moves to out.
+// A taken spill list goes first: everything in the ring now was pushed
+// after it was taken. The spill list is taken once the ring is empty.
+static int remote_pop(RemoteInbox *q,InboxSlot *out)
+{
+    if(!q->taken)
+    {
+        size_t head=atomic_load_explicit(&q->head,memory_order_relaxed);
+        RemoteCell *c=&q->cells[head%REMOTE_CAP];
+        if(atomic_load_explicit(&c->seq,memory_order_acquire)==head+1)
+        {
+            out->env=c->env;
+            out->id=c->id;
+            out->enq_ns=c->enq_ns;
+            atomic_store_explicit(&c->seq,head+REMOTE_CAP,memory_order_release);
+            atomic_store_explicit(&q->head,head+1,memory_order_relaxed);
+            return 0;
+        }
+        // A claimed cell not filled yet was pushed before any spill.
+        if(atomic_load(&q->tail)!=head||!atomic_load_explicit(&q->spilled,memory_order_acquire)) return -1;
+        pthread_mutex_lock(&q->spill_lock);
+        q->taken=q->spill;
+        atomic_store_explicit(&q->taken_count,atomic_load(&q->spilled),memory_order_relaxed);
+        q->spill=NULL;
+        q->spill_tail=&q->spill;
+        atomic_store_explicit(&q->spilled,0,memory_order_release);
+        pthread_mutex_unlock(&q->spill_lock);
+    }
+    RemoteSpill *s=q->taken;
+    q->taken=s->next;
+    atomic_fetch_sub_explicit(&q->taken_count,1,memory_order_relaxed);
+    *out=s->slot;
+    free(s);
     return 0;
 }
+// === DROP REASONS ===
+// Every drop names why it happened, so permission errors, overload and
+// routing mistakes can be told apart.
+typedef enum{
+    DROP_CAPABILITY_DENIED,
+    DROP_KIND_UNHANDLED,
+    DROP_INBOX_FULL,
+    DROP_NO_ROUTE,
+    DROP_BUDGET_EXCEEDED,
+    DROP_OVERSIZED,
+    DROP_SUPERSEDED,        // replaced in its inbox by a newer Message
+    DROP_REASON_COUNT
+}DropReason;
+static const char *const drop_reason_names[DROP_REASON_COUNT]={
+    [DROP_CAPABILITY_DENIED]="capability_denied",
+    [DROP_KIND_UNHANDLED]="kind_unhandled",
+    [DROP_INBOX_FULL]="inbox_full",
+    [DROP_NO_ROUTE]="no_route",
+    [DROP_BUDGET_EXCEEDED]="budget_exceeded",
+    [DROP_OVERSIZED]="oversized",
+    [DROP_SUPERSEDED]="superseded",
+};
+typedef _Atomic unsigned long DropCounters[DROP_REASON_COUNT];
+// === ACCOUNTING ===
+// With -a every handler call is charged to its Doer and the Message's
+// kind: TSC ticks (rdtsc; nanoseconds where there is no TSC), and,
+// where perf_event_open allows it, retired instructions and last-level
+// cache misses of the calling thread. Each thread opens its own two
+// counters on first use and reads them in user space with rdpmc
+// through the event's mmap page, falling back to read(2); a counter
+// the kernel refuses stays zero. A Doer runs on one thread at a time,
+// so its cost counters have a single writer.
+enum{
+    ACCT_TICKS,
+    ACCT_INSTRUCTIONS,
+    ACCT_LLC_MISSES,
+    ACCT_COUNT
+};
+static const char *const acct_names[ACCT_COUNT]={"ticks","instructions","llc_misses"};
+typedef struct{
+    Counter handled;
+    Counter value[ACCT_COUNT];
+}KindCost;
+typedef struct{
+    int init;
+    int fd[ACCT_COUNT];             // [ACCT_TICKS] unused
+    struct perf_event_mmap_page *page[ACCT_COUNT];
+}AcctThread;
+static _Thread_local AcctThread t_acct;
+// Which perf counters some thread could open (the report omits the rest).
+static _Atomic int g_acct_available[ACCT_COUNT];
+static void acct_thread_open(void)
+{
+    static const uint64_t config[ACCT_COUNT]={
+        [ACCT_INSTRUCTIONS]=PERF_COUNT_HW_INSTRUCTIONS,
+        [ACCT_LLC_MISSES]=PERF_COUNT_HW_CACHE_MISSES
+    };
+    t_acct.init=1;
+    for(int i=ACCT_INSTRUCTIONS;i<ACCT_COUNT;i++)
+    {
+        struct perf_event_attr attr={
+            .type=PERF_TYPE_HARDWARE,
+            .size=sizeof(attr),
+            .config=config[i],
+            .exclude_kernel=1,
+            .exclude_hv=1
+        };
+        t_acct.fd[i]=(int)syscall(SYS_perf_event_open,&attr,0,-1,-1,PERF_FLAG_FD_CLOEXEC);
+        t_acct.page[i]=NULL;
+        if(t_acct.fd[i]<0) continue;
+        atomic_store_explicit(&g_acct_available[i],1,memory_order_relaxed);
+        void *p=mmap(NULL,(size_t)sysconf(_SC_PAGESIZE),PROT_READ,MAP_SHARED,t_acct.fd[i],0);
+        if(p!=MAP_FAILED) t_acct.page[i]=p;
+    }
+}
+static void acct_thread_close(void)
+{
+    if(!t_acct.init) return;
+    for(int i=ACCT_INSTRUCTIONS;i<ACCT_COUNT;i++)
+    {
+        if(t_acct.page[i]) munmap(t_acct.page[i],(size_t)sysconf(_SC_PAGESIZE));
+        if(t_acct.fd[i]>=0) close(t_acct.fd[i]);
+    }
+    t_acct.init=0;
+}
+static inline uint64_t acct_ticks(void)
+{
+#if defined(__x86_64__)||defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return monotonic_ns();
+#endif
+}
+static uint64_t acct_read(int i)
+{
+    if(t_acct.fd[i]<0) return 0;
+#if defined(__x86_64__)||defined(__i386__)
+    struct perf_event_mmap_page *pc=t_acct.page[i];
+    if(pc&&pc->cap_user_rdpmc)
+    {
+        for(;;)
+        {
+            uint32_t seq=pc->lock;
+            atomic_signal_fence(memory_order_acq_rel);
+            uint32_t idx=pc->index;
+            int64_t count=pc->offset;
+            if(idx)
+            {
+                int64_t pmc=(int64_t)__builtin_ia32_rdpmc((int)idx-1);
+                count+=(int64_t)((uint64_t)pmc<<(64-pc->pmc_width))>>(64-pc->pmc_width);
+            }
+            atomic_signal_fence(memory_order_acq_rel);
+            if(pc->lock!=seq) continue;
+            if(idx) return (uint64_t)count;
+            break;      // not on a PMU right now: ask the kernel
+        }
+    }
+#endif
+    uint64_t v;
+    return read(t_acct.fd[i],&v,sizeof(v))==sizeof(v) ? v : 0;
+}
+static inline void acct_sample(uint64_t v[ACCT_COUNT])
+{
+    if(!t_acct.init) acct_thread_open();
+    v[ACCT_INSTRUCTIONS]=acct_read(ACCT_INSTRUCTIONS);
+    v[ACCT_LLC_MISSES]=acct_read(ACCT_LLC_MISSES);
+    v[ACCT_TICKS]=acct_ticks();
+}
+static inline void acct_charge(KindCost *k,const uint64_t before[ACCT_COUNT])
+{
+    uint64_t after[ACCT_COUNT];
+    after[ACCT_TICKS]=acct_ticks();
+    after[ACCT_INSTRUCTIONS]=acct_read(ACCT_INSTRUCTIONS);
+    after[ACCT_LLC_MISSES]=acct_read(ACCT_LLC_MISSES);
+    counter_add(&k->handled,1);
+    for(int i=0;i<ACCT_COUNT;i++) counter_add(&k->value[i],after[i]-before[i]);
+}
+// Handle latency (enqueue to end of handle) in log2 buckets:
+// bucket i counts latencies below 2^(i+LATENCY_SHIFT) ns, the last one
+// everything above.
+#define LATENCY_SHIFT 8
+#define LATENCY_BUCKETS 24
+typedef struct{
+    Counter handled;
+    Counter latency[LATENCY_BUCKETS];
+    Counter latency_sum_ns;
+    KindCost cost[MSGK_COUNT];  // -a
+}DoerStats;
+static void doer_stats_record(DoerStats *st,uint64_t enq_ns)
+{
+    counter_add(&st->handled,1);
+    if(!enq_ns) return;
+    uint64_t ns=monotonic_ns()-enq_ns;
+    uint64_t scaled=ns>>LATENCY_SHIFT;
+    int b=scaled ? 64-__builtin_clzll(scaled) : 0;
+    if(b>=LATENCY_BUCKETS) b=LATENCY_BUCKETS-1;
+    counter_add(&st->latency[b],1);
+    counter_add(&st->latency_sum_ns,ns);
+}
 typedef struct Doer Doer;
+typedef struct Runtime Runtime;
 struct Doer{
+    Runtime *rt;    // the runtime this Doer belongs to
     const char *name;
-    Inbox inbox;
-    CapabilitySet caps;
-    void (*handle)(Doer *self,const Message *msg);
+    int slot;
+    int cap_slot;   // row of the capability image this Doer is validated by
+    int affinity;   // Doers of one affinity group share a worker
+    int worker;
+    Inbox inbox;         // same-worker deliveries: no atomics
+    RemoteInbox *remote; // deliveries from other workers, set up with -w
+    struct NodeConn *proxy; // -R: the Doer runs on another node
+    DropCounters drops;
+    DoerStats stats;
+    // OFFLOAD: blocking jobs queued for this Doer, under the pool lock.
+    struct OffloadJob *offload_head;
+    struct OffloadJob **offload_tail;
+    int offload_queued;
+    int offload_state;
+    Doer *offload_next;     // on the pool's ready list
 };
-static void doer_a_handle(Doer *self,const Message *msg)
+// Worker the calling thread runs as in its runtime (-1: a thread that
+// drives runtimes itself, such as main).
+static _Thread_local int t_worker=-1;
+static int doer_has_work(Doer *d)
+{
+    return !inbox_empty(&d->inbox)||(d->remote&&!remote_empty(d->remote));
+}
+// Race-free depth for other threads (pool choice, metrics).
+static unsigned long doer_depth(Doer *d)
+{
+    return counter_get(&d->inbox.pushed)-counter_get(&d->inbox.popped)
+           +(d->remote ? remote_depth(d->remote) : 0);
+}
+// Handlers are bound per (Doer, kind) in the rule file, so none of
+// them needs to branch on msg->kind.
+static void doer_a_on_app(Doer *self,const Message *msg)
 {
     (void)self;
-    if(msg->kind==MSGK_STDIN_LINE)
-    {
-        printf("[A]:message from stdin\n");
-    }
     printf("msg %d cap %d [A]:%s\n",msg->id,msg->cap,msg->payload);
 }
+static void doer_a_on_stdin(Doer *self,const Message *msg)
+{
+    printf("[A]:message from stdin\n");
+    doer_a_on_app(self,msg);
+}
 static void doer_b_handle(Doer *self,const Message *  msg)
 {
     (void)self;
     printf("msg %d cap %d [B]:%s\n",msg->id,msg->cap,msg->payload);
 }
-static Doer g_doer_a;
-static Doer g_doer_b;
-static void runtime_init(void)
+static void doer_w_handle(Doer *self,const Message *msg)
 {
-    g_doer_a.name="A";
-    g_doer_a.handle=doer_a_handle;
-    inbox_init(&g_doer_a.inbox);
-    g_doer_a.caps.allowed_caps[0]=1;
-    g_doer_a.caps.cap_count=1;
-
-    g_doer_b.name="B";
-    g_doer_b.handle=doer_b_handle;
-    inbox_init(&g_doer_b.inbox);
-    g_doer_b.caps.allowed_caps[0]=2;
-    g_doer_b.caps.cap_count=1;
+    printf("msg %d cap %d [%s]:%s\n",msg->id,msg->cap,self->name,msg->payload);
 }
-// === MINT ===
-// Responsible for creating unique message/capability identities.
-static int mint_new_cap(void)
+// Timer requests; defined with the wheel in TIMER.
+static void doer_t_schedule(Doer *self,const Message *msg);
+// Pipeline stage: prints, then forwards (defined after runtime_route).
+static void doer_stage(Doer *self,const Message *msg);
+// Delivery to a proxy Doer; defined with the links in NODES.
+static void node_forward(Doer *d,Envelope *e,int id);
+// === DISPATCH ===
+// Static handler table: one switch case per (capability slot, kind)
+// binding in the rule file. Every call is direct and can be inlined;
+// there is no function pointer on the Doer. Kinds without a binding
+// never reach here: runtime_emit rejects them before enqueueing.
+#define RULES_HANDLER_CASE(cap_slot_,kind_,handler_) \
+    case (cap_slot_)*MSGK_COUNT+(kind_): handler_(d,m); return;
+static inline void doer_dispatch(Doer *d,const Message *m)
 {
-    return ++mint_cap_id;
+    switch(d->cap_slot*MSGK_COUNT+(int)m->kind)
+    {
+        RULES_HANDLERS(RULES_HANDLER_CASE)
+    }
 }
 // === VALIDATE ===
 // Determines whether a minted capability is usable by a given doer.
 // Returns boolean only. No side effects.
-static int validate_capability(int cap,const CapabilitySet *set)
+// One lookup in a capability set: capability → bitmap of doer slots.
+// The runtime starts from the compiled image and publishes changed
+// copies (see CAPABILITIES); a set never changes once published.
+typedef struct CapabilitySet{
+    struct CapabilitySet *next_retired;
+    uint64_t retired_at;            // epoch the set was replaced in
+    uint64_t doers[RULES_CAP_LIMIT][RULES_DOER_WORDS];
+}CapabilitySet;
+static int validate_capability(const CapabilitySet *cs,int cap,const Doer *d)
+{
+    if(cap<=0||cap>=RULES_CAP_LIMIT) return 0;
+    return (int)((cs->doers[cap][d->cap_slot>>6]>>(d->cap_slot&63))&1);
+}
+// Whether the rule file binds a handler for this kind on d.
+static int validate_kind(MessageKind kind,const Doer *d)
+{
+    return (unsigned)kind<MSGK_COUNT&&((rules_kind_mask[d->cap_slot]>>kind)&1);
+}
+// === JOURNAL ===
+// Optional write-ahead record of every Message outcome:
+//   created (runtime_emit) → handled (scheduler) | dropped (record_drop)
+// Records are batched in memory and group-committed with one
+// write + fdatasync per step, into preallocated fixed-size segments.
+// A crash loses nothing that was committed: recovery rebuilds exactly
+// the set of created Messages that never reached an outcome.
+#define JOURNAL_SEGMENT_BYTES (64u<<20)
+#define JOURNAL_BATCH_BYTES   (1u<<20)
+#define JOURNAL_MAGIC         "CMRJRNL2"
+typedef enum{
+    JREC_END=0,     // preallocated (zeroed) tail of a segment
+    JREC_CREATED,
+    JREC_HANDLED,
+    JREC_DROPPED
+}JournalRecType;
+typedef struct{
+    uint8_t type;
+    uint8_t kind;
+    uint16_t slot;
+    int32_t id;
+    int32_t cap;
+    int32_t to;
+    uint32_t payload_len;   // bytes following the record (CREATED only)
+}JournalRec;
+typedef struct{
+    const char *dir;
+    int fd;
+    uint32_t seg_no;
+    uint64_t seg_off;
+    char *buf;
+    size_t buf_len;
+    pthread_mutex_t lock;   // appends from worker threads
+}Journal;
+static void journal_init(Journal *j)
+{
+    memset(j,0,sizeof(*j));
+    j->fd=-1;
+    pthread_mutex_init(&j->lock,NULL);
+}
+static int journal_enabled(const Journal *j)
+{
+    return j->fd>=0;
+}
+static void journal_segment_path(char *out,size_t n,const char *dir,uint32_t seg_no)
+{
+    snprintf(out,n,"%s/journal-%08u.log",dir,seg_no);
+}
+static int journal_open_segment(Journal *j,uint32_t seg_no)
 {
-    for(int i=0;i<set->cap_count;i++)
+    char path[4096];
+    journal_segment_path(path,sizeof(path),j->dir,seg_no);
+    int fd=open(path,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if(fd<0) return -1;
+    // Preallocate so steady-state appends never extend the file
+    // and fdatasync does not have to flush size metadata.
+    if(posix_fallocate(fd,0,JOURNAL_SEGMENT_BYTES)!=0
+       ||pwrite(fd,JOURNAL_MAGIC,8,0)!=8)
     {
-        if(set->allowed_caps[i]==cap) 
-            return 1;
+        close(fd);
+        return -1;
     }
+    if(j->fd>=0)
+    {
+        fdatasync(j->fd);
+        close(j->fd);
+    }
+    j->fd=fd;
+    j->seg_no=seg_no;
+    j->seg_off=8;
     return 0;
 }
-static void runtime_record_drop(const Message *m, Doer *d)
-{
-    g_msg_dropped++;
-    printf(
-    "[DROP] msg=%d cap=%d to=%s payload=\"%s\"\n",
-    m->id,
-    m->cap,
-    d->name,
-    m->payload ? m->payload : "");
-}
-// === RUNTIME ===
-// Executes already-validated actions.
-// Does NOT perform permission checks.
-static void runtime_emit(const Message *src,Doer *d)
+// Group commit: one write and one fdatasync for the whole batch.
+static int journal_commit(Journal *j)
 {
-    Message m=*src;
-    g_msg_created++;
-    m.id=++mint_msg_id;
-    if(!validate_capability(m.cap,&d->caps))
+    if(j->fd<0||j->buf_len==0) return 0;
+    if(j->seg_off+j->buf_len>JOURNAL_SEGMENT_BYTES)
     {
-        runtime_record_drop(&m, d);
+        if(journal_open_segment(j,j->seg_no+1)!=0) return -1;
     }
-    else if (inbox_push(&d->inbox, &m) != 0)
+    size_t done=0;
+    while(done<j->buf_len)
     {
-        runtime_record_drop(&m, d);
+        ssize_t w=pwrite(j->fd,j->buf+done,j->buf_len-done,(off_t)(j->seg_off+done));
+        if(w<0) return -1;
+        done+=(size_t)w;
     }
+    j->seg_off+=j->buf_len;
+    j->buf_len=0;
+    return fdatasync(j->fd);
 }
-// === RUNTIME ===
-// Executes already-validated actions.
-// Does NOT perform permission checks.
-static void runtime_route(const Message *msg)
+static void journal_append(Journal *j,const JournalRec *r,const char *payload)
 {
-    switch(msg->to)
+    size_t need=sizeof(*r)+r->payload_len;
+    if(j->buf_len+need>JOURNAL_BATCH_BYTES&&journal_commit(j)!=0)
     {
-        case TARGET_A:
-            runtime_emit(msg,&g_doer_a);
-            break;
-        case TARGET_B:
-            runtime_emit(msg,&g_doer_b);
-            break;
-        case TARGET_BOTH:
-            runtime_emit(msg,&g_doer_a);
-            runtime_emit(msg,&g_doer_b);
-            break;
+        perror("journal");
+        exit(1);
     }
+    memcpy(j->buf+j->buf_len,r,sizeof(*r));
+    if(r->payload_len) memcpy(j->buf+j->buf_len+sizeof(*r),payload,r->payload_len);
+    j->buf_len+=need;
 }
-static void dispatch_doer(Doer *d)
+static void journal_record(Journal *j,JournalRecType type,const Message *m,const Doer *d)
 {
-    Message msg;
-    while(inbox_pop(&d->inbox,&msg)==0)
+    if(!journal_enabled(j)) return;
+    JournalRec r={
+        .type=(uint8_t)type,
+        .kind=(uint8_t)m->kind,
+        .slot=(uint16_t)d->slot,
+        .id=m->id,
+        .cap=m->cap,
+        .to=m->to,
+    };
+    if(type==JREC_CREATED&&m->payload)
+        r.payload_len=(uint32_t)strlen(m->payload)+1;
+    pthread_mutex_lock(&j->lock);
+    journal_append(j,&r,m->payload);
+    pthread_mutex_unlock(&j->lock);
+}
+static void journal_close(Journal *j)
+{
+    if(j->fd>=0) close(j->fd);
+    free(j->buf);
+    pthread_mutex_destroy(&j->lock);
+    j->fd=-1;
+    j->buf=NULL;
+}
+// === DROP LOG ===
+// [DROP] lines are rate limited to DROP_LOG_BURST per window; the rest
+// are only counted and reported in one [DROP_SUMMARY] line at the end
+// of the step. Each runtime has its own log. A drop costs one relaxed
+// atomic add, no lock and no clock read: the driving thread reads the
+// clock at step end and opens a new window once a second has passed,
+// so a step longer than that shares one window.
+#define DROP_LOG_BURST 16
+typedef struct{
+    _Atomic unsigned lines;
+    _Atomic unsigned long suppressed[DROP_REASON_COUNT];
+    time_t window;      // driving thread only
+}DropLog;
+// Driving thread, between steps.
+static void drop_log_summary(DropLog *l)
+{
+    unsigned long v[DROP_REASON_COUNT],total=0;
+    for(int r=0;r<DROP_REASON_COUNT;r++)
+        total+=v[r]=atomic_exchange_explicit(&l->suppressed[r],0,memory_order_relaxed);
+    if(total)
+    {
+        printf("[DROP_SUMMARY] suppressed=%lu",total);
+        for(int r=0;r<DROP_REASON_COUNT;r++)
+        {
+            if(v[r]) printf(" %s=%lu",drop_reason_names[r],v[r]);
+        }
+        printf("\n");
+    }
+    time_t now=time(NULL);
+    if(now!=l->window)
     {
-        d->handle(d,&msg);
+        l->window=now;
+        atomic_store_explicit(&l->lines,0,memory_order_relaxed);
     }
 }
-#define MAX_DOERS 8
+static int drop_log_allow(DropLog *l,DropReason why)
+{
+    if(atomic_load_explicit(&l->lines,memory_order_relaxed)<DROP_LOG_BURST
+       &&atomic_fetch_add_explicit(&l->lines,1,memory_order_relaxed)<DROP_LOG_BURST)
+        return 1;
+    atomic_fetch_add_explicit(&l->suppressed[why],1,memory_order_relaxed);
+    return 0;
+}
+// === ADMISSION ===
+// Budgets enforced where Messages enter routing. A Message that would
+// push in-flight deliveries or their payload bytes over budget is
+// refused as a whole, before any delivery is created, so overload
+// degrades into explicit rejections instead of growth.
+// A budget of 0 means unlimited.
+typedef struct{
+    unsigned long max_msgs;
+    unsigned long max_bytes;
+    unsigned long max_payload;  // per Message
+}Admission;
+// === POOLS ===
+// A pool is a set of identical Doers behind one target. Members share
+// the capability row of the pool template declared in the rule file,
+// and each Message goes to the less loaded of two randomly chosen
+// members (power of two choices on inbox depth).
+typedef struct{
+    const char *name;
+    int cap_slot;
+    Doer **members;
+    int count;
+    _Atomic uint32_t rng;   // racy between workers by design: any value is fine
+}DoerPool;
+static uint32_t pool_rand(DoerPool *p)
+{
+    uint32_t x=atomic_load_explicit(&p->rng,memory_order_relaxed);
+    x^=x<<13;
+    x^=x>>17;
+    x^=x<<5;
+    atomic_store_explicit(&p->rng,x,memory_order_relaxed);
+    return x;
+}
+static Doer *pool_pick(DoerPool *p)
+{
+    if(p->count==0) return NULL;
+    if(p->count==1) return p->members[0];
+    uint32_t r=pool_rand(p);
+    Doer *a=p->members[r%(uint32_t)p->count];
+    Doer *b=p->members[(r>>16)%(uint32_t)p->count];
+    return doer_depth(b)<doer_depth(a) ? b : a;
+}
+#define MAX_DOERS 4096
+_Static_assert(RULES_DOER_COUNT<=MAX_DOERS,"rule set declares more doers than MAX_DOERS");
 typedef struct{
     Doer *list[MAX_DOERS];
     int count;
@@ -279,136 +1201,4236 @@ static void registry_init(DoerRegistry *r)
 static int registry_add(DoerRegistry *r,Doer *d)
 {
     if(r->count>=MAX_DOERS) return -1;
+    d->slot=r->count;
     r->list[r->count++]=d;
     return 0;
 }
+// === IDLE ===
+// How a thread waits inside a step for work it cannot take yet: spin
+// with a CPU pause, then yield, then park on a futex. A futex wake-up
+// costs microseconds, so the first Message of a burst should find its
+// worker spinning; but a core spinning through a quiet period is
+// wasted. The spin budget follows the recent idle periods: twice their
+// moving average while that is short, the minimum once work arrives
+// later than a spin would last. With a single CPU the waker can only
+// run once the waiter gives up the core, so there is no spin at all.
+// The waker makes the waiter's condition true with a seq_cst operation
+// and then loads parked; the waiter stores parked and then rechecks
+// its condition. One of the two always sees the other, so a wake-up
+// is never lost and a running waiter is never woken by a syscall.
+#define IDLE_SPIN_MIN_NS 1000
+#define IDLE_SPIN_MAX_NS 50000
+#define IDLE_YIELDS 16
 typedef struct{
-    DoerRegistry *reg;
-}Scheduler;
-static int scheduler_has_work(const Scheduler *s)
+    _Alignas(64) _Atomic uint32_t word;     // futex: bumped per wake-up
+    _Atomic int parked;
+    int spin;                       // more than one CPU online
+    Counter gap_ns;                 // moving average of idle periods
+    Counter parks;
+}IdleWaiter;
+static void idle_init(IdleWaiter *iw)
 {
-    for(int i=0;i<s->reg->count;i++)
-    {
-        Doer *d=s->reg->list[i];
-        if(!inbox_empty(&d->inbox)){return 1;}
-    }
-    return 0;
+    iw->spin=sysconf(_SC_NPROCESSORS_ONLN)>1;
 }
-static unsigned long runtime_pending_messages(const DoerRegistry *reg)
+static inline void cpu_relax(void)
 {
-    unsigned long n = 0;
-    for (int i = 0; i < reg->count; i++) {
-        Inbox *q = &reg->list[i]->inbox;
-        if (q->tail >= q->head)
-            n += (q->tail - q->head);
-        else
-            n += (INBOX_CAP - q->head + q->tail);
-    }
-    return n;
+#if defined(__x86_64__)||defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
 }
-static void runtime_print_message_balance(const DoerRegistry *reg)
+static uint64_t idle_spin_budget(IdleWaiter *iw)
 {
-    unsigned long pending = runtime_pending_messages(reg);
-    long balance = (long)g_msg_created
-                 - (long)g_msg_handled
-                 - (long)g_msg_dropped
-                 - (long)pending;
-    printf("[MSG_BALANCE] created=%lu enqueued=%lu handled=%lu dropped=%lu pending=%lu balance=%ld\n",
-       g_msg_created, g_msg_enqueued, g_msg_handled, g_msg_dropped,pending, balance);
+    uint64_t gap=counter_get(&iw->gap_ns);
+    if(!iw->spin) return 0;
+    if(gap>IDLE_SPIN_MAX_NS/2||gap<IDLE_SPIN_MIN_NS/2) return IDLE_SPIN_MIN_NS;
+    return 2*gap;
 }
-// === RUNTIME ===
-// Executes already-validated actions.
-// Does NOT perform permission checks.
-static void scheduler_round(Scheduler *s)
+static void idle_park(IdleWaiter *iw,int (*ready)(void *),void *arg)
 {
-    for(int i=0;i<s->reg->count;i++)
+    for(int i=0;i<IDLE_YIELDS;i++)
+    {
+        if(ready(arg)) return;
+        sched_yield();
+    }
+    while(!ready(arg))
     {
-        Doer *d=s->reg->list[i];
-        Message m;
-        if(inbox_pop(&d->inbox,&m)==0)
+        uint32_t seq=atomic_load(&iw->word);
+        atomic_store(&iw->parked,1);
+        if(!ready(arg))
         {
-            d->handle(d,&m);
-            g_msg_handled++;
+            syscall(SYS_futex,&iw->word,FUTEX_WAIT_PRIVATE,seq,NULL,NULL,0);
+            counter_add(&iw->parks,1);
         }
+        atomic_store(&iw->parked,0);
     }
 }
-// External world → CMR boundary
-// Raw events must be converted into Messages before entering runtime.
-static void emit_stdin_event(void)
+// Returns once ready(arg) holds. Owner thread only.
+static void idle_wait(IdleWaiter *iw,int (*ready)(void *),void *arg)
 {
-    char buf[1024];
-    fgets(buf,sizeof(buf),stdin);
-    size_t n=strlen(buf);
-    if(n>0&&buf[n-1]=='\n')
+    uint64_t start=monotonic_ns();
+    uint64_t budget=idle_spin_budget(iw);
+    for(unsigned i=1;!ready(arg);i++)
     {
-        buf[n-1]='\0';
+        if((i%64==0||!budget)&&monotonic_ns()-start>=budget)
+        {
+            idle_park(iw,ready,arg);
+            break;
+        }
+        cpu_relax();
     }
-    char *p=buf;
+    uint64_t gap=monotonic_ns()-start;
+    uint64_t avg=counter_get(&iw->gap_ns);
+    atomic_store_explicit(&iw->gap_ns,avg-avg/4+gap/4,memory_order_relaxed);
+}
+// Call after making the waiter's condition true with a seq_cst operation.
+static inline void idle_wake(IdleWaiter *iw)
+{
+    if(!atomic_load(&iw->parked)) return;
+    atomic_fetch_add(&iw->word,1);
+    syscall(SYS_futex,&iw->word,FUTEX_WAKE_PRIVATE,1,NULL,NULL,0);
+}
+// === WORKERS (types) ===
+// See WORKERS below for how a step runs.
+typedef struct{
+    Runtime *rt;
+    int index;
+    Doer **doers;
+    int count;
+    pthread_t thread;
+    IdleWaiter idle;                // woken by remote deliveries, step end
+}Worker;
+// A worker's last quiescent epoch (CAPABILITIES), one per cache line.
+typedef struct{
+    _Alignas(64) _Atomic uint64_t epoch;
+}EpochSlot;
+// === RUNTIME CONTEXT ===
+// Everything a runtime mutates lives in one Runtime: its Doers and
+// registry, mint, counters, drops, admission, topics, timers, journal
+// and workers. Every runtime API takes it explicitly (handlers reach it
+// through self->rt), so several runtimes can share a process, one per
+// core or tenant, without sharing state. Only the allocator free
+// lists and the stdin reader are per process.
+struct Runtime{
+    // Shard 0 belongs to the thread driving the runtime, shard i+1 to
+    // worker i.
+    CounterShard counters[MAX_WORKERS+1];
+    int counter_shards;
+    // Set before the metrics thread starts; enqueue times are only
+    // taken when someone can read the latency histograms.
+    int metrics_enabled;
+    int acct_enabled;               // -a: charge handler calls to Doers
+    _Alignas(64) _Atomic int mint_msg_id;
+    int mint_cap_id;
+    Doer doers[RULES_DOER_COUNT];   // slot i is rule doer i
+    DoerPool pools[RULES_POOL_COUNT ? RULES_POOL_COUNT : 1];
+    DoerRegistry reg;
+    int next_affinity;              // next group for a pool member
+    DropCounters drop_edge;         // refused before any Doer was chosen
+    DropLog drop_log;
+    Admission admission;
+    Journal journal;
+    struct TimerWheel *timer;
+    // TOPICS: subscriber lists, their writer lock and retired copies.
+    _Atomic(struct SubscriberList *) topic_subs[TOPIC_COUNT ? TOPIC_COUNT : 1];
+    pthread_mutex_t topic_writer;
+    struct SubscriberList *topic_retired;
+    // CAPABILITIES: the published set, its writer lock, replaced sets
+    // awaiting reclamation, the epoch and each worker's last quiescent
+    // epoch.
+    _Atomic(CapabilitySet *) caps;
+    pthread_mutex_t caps_writer;
+    CapabilitySet *caps_retired;
+    _Atomic uint64_t caps_epoch;
+    uint64_t caps_clean_epoch;      // nothing retired up to here
+    EpochSlot caps_seen[MAX_WORKERS];
+    // TRACE: the recording switch and, with a trace file, its buffers.
+    _Atomic int trace_on;
+    struct Tracer *trace;
+    // WORKERS: how many drain the inboxes (0: the driving thread does,
+    // inline) and the step handshake with them.
+    int worker_count;
+    Worker workers[MAX_WORKERS];
+    pthread_mutex_t step_lock;
+    pthread_cond_t step_start;
+    pthread_cond_t step_parked;
+    unsigned step_gen;
+    int step_parked_count;
+    int step_stop;
+    // Workers in a step that still have work, plus cross-worker
+    // deliveries not yet picked up; the step is over at zero.
+    _Alignas(64) _Atomic long step_outstanding;
+    IdleWaiter step_idle;           // the driving thread, waiting for zero
+    // NODES: links to other processes (-L, -R), and the Messages they
+    // brought in or took over, for admission control on any thread.
+    struct Node *node;
+    _Atomic unsigned long node_received;
+    _Atomic unsigned long node_forwarded;   // acknowledged by the peer
+    // OFFLOAD: the blocking-handler pool (-O) and the Messages it has
+    // taken from inboxes but the driving thread not yet finished.
+    struct Offload *offload;
+    _Atomic unsigned long offload_pending;
+    // Keeps a restored snapshot mapped: its payloads point into it.
+    void *snapshot_map;
+    size_t snapshot_map_len;
+};
+static inline CounterShard *runtime_shard(Runtime *rt)
+{
+    return &rt->counters[t_worker+1];
+}
+static unsigned long counter_total(Runtime *rt,size_t off)
+{
+    unsigned long sum=0;
+    for(int i=0;i<rt->counter_shards;i++)
+        sum+=counter_get((Counter *)((char *)&rt->counters[i]+off));
+    return sum;
+}
+#define COUNTER_TOTAL(rt,field) counter_total(rt,offsetof(CounterShard,field))
+// Set on an offload thread while it runs a blocking handler; routes
+// are then captured for the driving thread (OFFLOAD). Every other API
+// that changes runtime state calls offload_forbid: the rule file may
+// mark any Doer blocking, and a handler that arms a timer or changes
+// a subscription from there would race the driving thread.
+static _Thread_local struct OffloadJob *t_offload;
+static void offload_forbid(const char *api)
+{
+    if(!t_offload) return;
+    fprintf(stderr,"%s called from a blocking handler\n",api);
+    abort();
+}
+// === MINT ===
+// Responsible for creating unique message/capability identities.
+// Worker threads reserve message ids in blocks so they do not contend
+// on one cache line; a thread driving runtimes itself takes them one at
+// a time, which keeps single-threaded ids dense and ordered and lets
+// one thread drive several runtimes.
+#define MINT_BLOCK 256
+static _Thread_local int t_mint_next=0;
+static _Thread_local int t_mint_end=0;
+static _Thread_local int t_mint_block=1;
+static int mint_next_msg_id(Runtime *rt)
+{
+    if(t_mint_next==t_mint_end)
+    {
+        t_mint_next=atomic_fetch_add_explicit(&rt->mint_msg_id,t_mint_block,memory_order_relaxed)+1;
+        t_mint_end=t_mint_next+t_mint_block;
+    }
+    return t_mint_next++;
+}
+// === CAPABILITIES ===
+// Capability sets are read-copy-update: runtime_emit, runtime_multicast
+// and the scheduler validate against whatever set one acquire load
+// returns, without a lock. runtime_grant / runtime_revoke copy the
+// current set under caps_writer, publish the copy and retire the old
+// set tagged with the new epoch.
+// A worker holds a set only while it handles a Message, so it is
+// quiescent between scheduling passes and records the epoch it saw
+// there; while parked it is offline. A retired set is freed once every
+// online worker has recorded its tag or later. Reclamation runs on the
+// driving thread (between steps, and while it waits for one), which
+// holds no set at that point.
+// A Message whose capability is gone when it is emitted or dispatched
+// is dropped as capability_denied, so revocation also reaches Messages
+// already queued.
+#define CAPS_OFFLINE UINT64_MAX
+static inline const CapabilitySet *caps_current(Runtime *rt)
+{
+    return atomic_load_explicit(&rt->caps,memory_order_acquire);
+}
+static inline void caps_quiescent(Runtime *rt,int w)
+{
+    uint64_t e=atomic_load_explicit(&rt->caps_epoch,memory_order_acquire);
+    atomic_store_explicit(&rt->caps_seen[w].epoch,e,memory_order_release);
+}
+// The fence pairs with the one in caps_reclaim: a reclaimer that still
+// saw this worker offline published its new set before the fence, so
+// every load of rt->caps after it returns that set or a later one.
+static void caps_online(Runtime *rt,int w)
+{
+    caps_quiescent(rt,w);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+static void caps_offline(Runtime *rt,int w)
+{
+    atomic_store_explicit(&rt->caps_seen[w].epoch,CAPS_OFFLINE,memory_order_release);
+}
+// Grants (grant=1) or revokes cap for the Doer or pool in cap_slot.
+// Any thread may call it. Returns -1 for a capability outside the
+// compiled range or an unknown slot.
+static int caps_update(Runtime *rt,int cap,int cap_slot,int grant)
+{
+    offload_forbid(grant ? "runtime_grant" : "runtime_revoke");
+    if(cap<=0||cap>=RULES_CAP_LIMIT||cap_slot<0||cap_slot>=RULES_DOER_COUNT+RULES_POOL_COUNT) return -1;
+    CapabilitySet *next=malloc(sizeof(*next));
+    if(!next)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    pthread_mutex_lock(&rt->caps_writer);
+    CapabilitySet *cur=atomic_load_explicit(&rt->caps,memory_order_relaxed);
+    memcpy(next->doers,cur->doers,sizeof(next->doers));
+    if(grant)
+        next->doers[cap][cap_slot>>6]|=1ull<<(cap_slot&63);
+    else
+        next->doers[cap][cap_slot>>6]&=~(1ull<<(cap_slot&63));
+    next->next_retired=NULL;
+    atomic_exchange_explicit(&rt->caps,next,memory_order_seq_cst);
+    cur->retired_at=atomic_fetch_add_explicit(&rt->caps_epoch,1,memory_order_seq_cst)+1;
+    cur->next_retired=rt->caps_retired;
+    rt->caps_retired=cur;
+    pthread_mutex_unlock(&rt->caps_writer);
+    return 0;
+}
+static int runtime_grant(Runtime *rt,int cap,int cap_slot)
+{
+    return caps_update(rt,cap,cap_slot,1);
+}
+static int runtime_revoke(Runtime *rt,int cap,int cap_slot)
+{
+    return caps_update(rt,cap,cap_slot,0);
+}
+// Frees the retired sets no worker can still hold. Driving thread only.
+static void caps_reclaim(Runtime *rt)
+{
+    if(atomic_load_explicit(&rt->caps_epoch,memory_order_relaxed)==rt->caps_clean_epoch) return;
+    CapabilitySet *done=NULL;
+    pthread_mutex_lock(&rt->caps_writer);
+    atomic_thread_fence(memory_order_seq_cst);
+    uint64_t min=CAPS_OFFLINE;
+    for(int i=0;i<rt->worker_count;i++)
+    {
+        uint64_t e=atomic_load_explicit(&rt->caps_seen[i].epoch,memory_order_acquire);
+        if(e<min) min=e;
+    }
+    for(CapabilitySet **pp=&rt->caps_retired;*pp;)
+    {
+        CapabilitySet *cs=*pp;
+        if(cs->retired_at<=min)
+        {
+            *pp=cs->next_retired;
+            cs->next_retired=done;
+            done=cs;
+        }
+        else
+            pp=&cs->next_retired;
+    }
+    if(!rt->caps_retired)
+        rt->caps_clean_epoch=atomic_load_explicit(&rt->caps_epoch,memory_order_relaxed);
+    pthread_mutex_unlock(&rt->caps_writer);
+    while(done)
+    {
+        CapabilitySet *next=done->next_retired;
+        free(done);
+        done=next;
+    }
+}
+// === TRACE ===
+// Optional record of every Message's path, written as Chrome trace
+// JSON (chrome://tracing, ui.perfetto.dev). Each thread appends to its
+// own buffer, indexed like the counter shards, so recording takes no
+// lock; the driving thread flushes between steps. When tracing is off
+// every hook is one relaxed load and a predicted branch.
+// Per Message id: an "emit" slice with a flow arrow to the slice that
+// handles or drops it, a "queued" async span from enqueue to dequeue,
+// and the handler as a slice named after the Doer.
+#define TRACE_CHUNK 4096
+#define TRACE_MAX_EVENTS (1u<<20)   // per thread; further events are lost
+#define TRACE_FLUSH_EVENTS (1u<<16) // step end flushes past this many
+typedef enum{
+    TRACE_EMIT,
+    TRACE_ENQUEUE,
+    TRACE_DEQUEUE,
+    TRACE_HANDLE_BEGIN,
+    TRACE_HANDLE_END,
+    TRACE_DROP
+}TraceType;
+typedef struct{
+    uint64_t ns;
+    const Doer *d;                  // NULL: refused before any Doer
+    int32_t id;
+    uint8_t type;
+    uint8_t why;
+}TraceEvent;
+typedef struct{
+    _Alignas(64) TraceEvent *ev;
+    uint32_t len;
+    uint32_t cap;
+    unsigned long lost;
+}TraceBuf;
+typedef struct Tracer{
+    FILE *out;
+    int wrote;                      // an event precedes: comma first
+    uint64_t base_ns;
+    TraceBuf bufs[MAX_WORKERS+1];
+}Tracer;
+static void trace_record(Runtime *rt,TraceType type,int id,const Doer *d,int why)
+{
+    TraceBuf *b=&rt->trace->bufs[t_worker+1];
+    if(b->len==b->cap)
+    {
+        TraceEvent *ev=b->cap<TRACE_MAX_EVENTS ? realloc(b->ev,(b->cap+TRACE_CHUNK)*sizeof(*ev)) : NULL;
+        if(!ev)
+        {
+            b->lost++;
+            return;
+        }
+        b->ev=ev;
+        b->cap+=TRACE_CHUNK;
+    }
+    b->ev[b->len++]=(TraceEvent){.ns=monotonic_ns(),.d=d,.id=id,.type=(uint8_t)type,.why=(uint8_t)why};
+}
+#define TRACE(rt,type,id,d,why) \
+    do{ \
+        if(__builtin_expect(atomic_load_explicit(&(rt)->trace_on,memory_order_relaxed),0)) \
+            trace_record(rt,type,id,d,why); \
+    }while(0)
+static void trace_json(Tracer *t,const char *fmt,...)
+{
+    va_list ap;
+    va_start(ap,fmt);
+    fputs(t->wrote ? ",\n" : "",t->out);
+    vfprintf(t->out,fmt,ap);
+    va_end(ap);
+    t->wrote=1;
+}
+// Writes and empties every buffer. Between steps only.
+static void trace_flush(Runtime *rt)
+{
+    Tracer *t=rt->trace;
+    if(!t) return;
+    for(int tid=0;tid<=MAX_WORKERS;tid++)
+    {
+        TraceBuf *b=&t->bufs[tid];
+        for(uint32_t i=0;i<b->len;i++)
+        {
+            const TraceEvent *e=&b->ev[i];
+            const char *name=e->d ? e->d->name : "(edge)";
+            double us=(double)(e->ns-t->base_ns)/1e3;
+            switch(e->type)
+            {
+                case TRACE_EMIT:
+                    trace_json(t,"{\"name\":\"emit\",\"cat\":\"msg\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":0.001,\"pid\":1,\"tid\":%d,"
+                               "\"args\":{\"msg\":%d,\"to\":\"%s\"}}",us,tid,e->id,name);
+                    trace_json(t,"{\"name\":\"msg\",\"cat\":\"flow\",\"ph\":\"s\",\"id\":%d,\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                               e->id,us,tid);
+                    break;
+                case TRACE_ENQUEUE:
+                case TRACE_DEQUEUE:
+                    trace_json(t,"{\"name\":\"queued\",\"cat\":\"queue\",\"ph\":\"%c\",\"id\":%d,\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+                               "\"args\":{\"doer\":\"%s\"}}",e->type==TRACE_ENQUEUE ? 'b' : 'e',e->id,us,tid,name);
+                    break;
+                case TRACE_HANDLE_BEGIN:
+                case TRACE_DROP:
+                    if(e->type==TRACE_DROP)
+                        trace_json(t,"{\"name\":\"drop %s\",\"cat\":\"drop\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":0.001,\"pid\":1,\"tid\":%d,"
+                                   "\"args\":{\"msg\":%d,\"doer\":\"%s\"}}",drop_reason_names[e->why],us,tid,e->id,name);
+                    else
+                        trace_json(t,"{\"name\":\"%s\",\"cat\":\"handle\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+                                   "\"args\":{\"msg\":%d}}",name,us,tid,e->id);
+                    trace_json(t,"{\"name\":\"msg\",\"cat\":\"flow\",\"ph\":\"f\",\"bp\":\"e\",\"id\":%d,\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                               e->id,us,tid);
+                    break;
+                case TRACE_HANDLE_END:
+                    trace_json(t,"{\"name\":\"%s\",\"cat\":\"handle\",\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",name,us,tid);
+                    break;
+            }
+        }
+        b->len=0;
+        if(b->lost)
+        {
+            trace_json(t,"{\"name\":\"trace_lost\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"events\":%lu}}",
+                       (double)(monotonic_ns()-t->base_ns)/1e3,tid,b->lost);
+            b->lost=0;
+        }
+    }
+    fflush(t->out);
+}
+// Starts a trace file at path with tracing on (after workers_start, so
+// worker threads get their names). Returns -1 if it cannot be created.
+static int trace_open(Runtime *rt,const char *path)
+{
+    Tracer *t=calloc(1,sizeof(*t));
+    if(!t) return -1;
+    t->out=fopen(path,"w");
+    if(!t->out)
+    {
+        free(t);
+        return -1;
+    }
+    t->base_ns=monotonic_ns();
+    fputs("[\n",t->out);
+    trace_json(t,"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"scat10\"}}");
+    trace_json(t,"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"main\"}}");
+    for(int i=0;i<rt->worker_count;i++)
+        trace_json(t,"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}",i+1,i);
+    rt->trace=t;
+    atomic_store(&rt->trace_on,1);
+    return 0;
+}
+// Turns recording on or off (no-op without a trace file). Between
+// steps only; switching off flushes what was recorded.
+static void trace_switch(Runtime *rt,int on)
+{
+    if(!rt->trace) return;
+    atomic_store(&rt->trace_on,on);
+    if(!on) trace_flush(rt);
+}
+// SIGUSR2 toggles recording; applied at the next step end.
+static volatile sig_atomic_t g_trace_toggle=0;
+static void trace_on_signal(int sig)
+{
+    (void)sig;
+    g_trace_toggle=1;
+}
+static void trace_step_end(Runtime *rt)
+{
+    if(!rt->trace) return;
+    if(g_trace_toggle)
+    {
+        g_trace_toggle=0;
+        trace_switch(rt,!atomic_load(&rt->trace_on));
+        printf("[TRACE] %s\n",atomic_load(&rt->trace_on) ? "on" : "off");
+    }
+    unsigned long buffered=0;
+    for(int i=0;i<=MAX_WORKERS;i++) buffered+=rt->trace->bufs[i].len;
+    if(buffered>TRACE_FLUSH_EVENTS) trace_flush(rt);
+}
+static void trace_close(Runtime *rt)
+{
+    Tracer *t=rt->trace;
+    if(!t) return;
+    atomic_store(&rt->trace_on,0);
+    trace_flush(rt);
+    fputs("\n]\n",t->out);
+    fclose(t->out);
+    for(int i=0;i<=MAX_WORKERS;i++) free(t->bufs[i].ev);
+    free(t);
+    rt->trace=NULL;
+}
+static void runtime_record_drop(const Message *m,Doer *d,DropReason why);
+// old was replaced in its inbox slot by a newer Message with its key.
+static void doer_supersede(Doer *d,const InboxSlot *old)
+{
+    Message m=old->env->msg;
+    m.id=old->id;
+    counter_add(&runtime_shard(d->rt)->inflight_bytes,-(unsigned long)old->env->payload_len);
+    runtime_record_drop(&m,d,DROP_SUPERSEDED);
+    envelope_release(old->env);
+}
+// Queues e in d's plain inbox, in place of a queued Message with its
+// key when d coalesces e's kind. Owner (or parked workers) only.
+static int doer_inbox_push(Doer *d,Envelope *e,int id,uint64_t enq_ns)
+{
+    InboxSlot old={0};
+    int rc=((rules_coalesce_kinds[d->cap_slot]>>e->msg.kind)&1)
+           ? inbox_push_coalesce(&d->inbox,e,id,enq_ns,&old)
+           : inbox_push_shared(&d->inbox,e,id,enq_ns);
+    if(rc>0) doer_supersede(d,&old);
+    return rc<0 ? -1 : 0;
+}
+// Same-worker deliveries, and every delivery made while the workers are
+// parked, take the plain ring. Everything else takes the remote ring,
+// refused against the watermark like the plain one: the owner moves it
+// into its inbox (doer_collect_remote).
+// A proxy's own inbox only receives from the link (NODES).
+static int doer_deliver_inbox(Doer *d,Envelope *e,int id)
+{
+    Runtime *rt=d->rt;
+    uint64_t enq_ns=rt->metrics_enabled ? monotonic_ns() : 0;
+    if(rt->worker_count==0||t_worker<0||d->worker==t_worker)
+    {
+        if(doer_inbox_push(d,e,id,enq_ns)!=0) return -1;
+    }
+    else
+    {
+        if(doer_depth(d)>=(unsigned long)d->inbox.high) return -1;
+        atomic_fetch_add_explicit(&rt->step_outstanding,1,memory_order_seq_cst);
+        remote_push(d->remote,e,id,enq_ns);
+        idle_wake(&rt->workers[d->worker].idle);
+    }
+    CounterShard *c=runtime_shard(rt);
+    counter_add(&c->enqueued,1);
+    counter_add(&c->inflight_bytes,e->payload_len);
+    TRACE(rt,TRACE_ENQUEUE,id,d,0);
+    return 0;
+}
+static int doer_deliver(Doer *d,Envelope *e,int id)
+{
+    if(d->proxy)
+    {
+        node_forward(d,e,id);
+        return 0;
+    }
+    return doer_deliver_inbox(d,e,id);
+}
+// Copies m into a fresh Envelope and delivers it (recovery, restore).
+static int doer_enqueue(Doer *d,const Message *m)
+{
+    Envelope *e=envelope_alloc(m);
+    int rc=doer_deliver(d,e,m->id);
+    envelope_release(e);
+    return rc;
+}
+// Owner only: moves what other workers delivered into the plain inbox,
+// coalescing it like a local delivery. The depth check at delivery
+// makes a full inbox here a race, dropped as inbox_full.
+static void doer_collect_remote(Doer *d)
+{
+    Runtime *rt=d->rt;
+    InboxSlot s;
+    while(remote_pop(d->remote,&s)==0)
+    {
+        atomic_fetch_sub_explicit(&rt->step_outstanding,1,memory_order_seq_cst);
+        if(doer_inbox_push(d,s.env,s.id,s.enq_ns)!=0)
+        {
+            Message m=s.env->msg;
+            m.id=s.id;
+            counter_add(&runtime_shard(rt)->inflight_bytes,-(unsigned long)s.env->payload_len);
+            runtime_record_drop(&m,d,DROP_INBOX_FULL);
+        }
+        envelope_release(s.env);
+    }
+}
+// Next Message for d, after taking in its remote deliveries.
+static int doer_take(Doer *d,Message *out,uint64_t *enq_ns)
+{
+    Runtime *rt=d->rt;
+    InboxSlot s;
+    if(d->remote&&!remote_empty(d->remote)) doer_collect_remote(d);
+    if(inbox_pop(&d->inbox,&s)!=0) return -1;
+    *out=s.env->msg;
+    out->id=s.id;
+    TRACE(rt,TRACE_DEQUEUE,s.id,d,0);
+    if(enq_ns) *enq_ns=s.enq_ns;
+    counter_add(&runtime_shard(rt)->inflight_bytes,-(unsigned long)s.env->payload_len);
+    envelope_release(s.env);
+    return 0;
+}
+static void runtime_record_drop(const Message *m, Doer *d, DropReason why)
+{
+    counter_add(&runtime_shard(d->rt)->dropped,1);
+    atomic_fetch_add_explicit(&d->drops[why],1,memory_order_relaxed);
+    TRACE(d->rt,TRACE_DROP,m->id,d,why);
+    journal_record(&d->rt->journal,JREC_DROPPED,m,d);
+    // Superseding is the policy working, not a fault worth a line.
+    if(why==DROP_SUPERSEDED||!drop_log_allow(&d->rt->drop_log,why)) return;
+    printf(
+    "[DROP] msg=%d cap=%d to=%s reason=%s payload=\"%s\"\n",
+    m->id,
+    m->cap,
+    d->name,
+    drop_reason_names[why],
+    m->payload ? m->payload : "");
+}
+// A Message refused before it reaches any Doer (no route, over budget)
+// is still minted and recorded: the input reaches an explicit outcome.
+static void runtime_record_refused(Runtime *rt,const Message *src,const char *where,DropReason why)
+{
+    Message m=*src;
+    CounterShard *c=runtime_shard(rt);
+    counter_add(&c->created,1);
+    counter_add(&c->dropped,1);
+    m.id=mint_next_msg_id(rt);
+    atomic_fetch_add_explicit(&rt->drop_edge[why],1,memory_order_relaxed);
+    TRACE(rt,TRACE_EMIT,m.id,NULL,0);
+    TRACE(rt,TRACE_DROP,m.id,NULL,why);
+    if(!drop_log_allow(&rt->drop_log,why)) return;
+    printf("[DROP] msg=%d cap=%d to=%s reason=%s payload=\"%s\"\n",
+           m.id,m.cap,where,drop_reason_names[why],m.payload ? m.payload : "");
+}
+static unsigned long runtime_inflight_messages(Runtime *rt)
+{
+    return COUNTER_TOTAL(rt,created)+atomic_load_explicit(&rt->node_received,memory_order_relaxed)
+           -COUNTER_TOTAL(rt,handled)-COUNTER_TOTAL(rt,dropped)
+           -atomic_load_explicit(&rt->node_forwarded,memory_order_relaxed);
+}
+static int admission_admit(Runtime *rt,const Message *m,unsigned long fanout,const char *where)
+{
+    Admission *a=&rt->admission;
+    unsigned long len=m->payload ? (unsigned long)strlen(m->payload) : 0;
+    unsigned long bytes=len*fanout;
+    if(a->max_payload&&len>a->max_payload)
+    {
+        counter_add(&runtime_shard(rt)->rejected,1);
+        runtime_record_refused(rt,m,where,DROP_OVERSIZED);
+        return 0;
+    }
+    if((a->max_msgs&&runtime_inflight_messages(rt)+fanout>a->max_msgs)
+       ||(a->max_bytes&&COUNTER_TOTAL(rt,inflight_bytes)+bytes>a->max_bytes))
+    {
+        counter_add(&runtime_shard(rt)->rejected,1);
+        runtime_record_refused(rt,m,where,DROP_BUDGET_EXCEEDED);
+        return 0;
+    }
+    return 1;
+}
+static void runtime_print_admission(Runtime *rt)
+{
+    Admission *a=&rt->admission;
+    if(!a->max_msgs&&!a->max_bytes&&!a->max_payload) return;
+    printf("[ADMISSION] inflight=%lu/%lu bytes=%lu/%lu rejected=%lu\n",
+           runtime_inflight_messages(rt),a->max_msgs,
+           COUNTER_TOTAL(rt,inflight_bytes),a->max_bytes,COUNTER_TOTAL(rt,rejected));
+}
+// === RUNTIME ===
+// Executes already-validated actions.
+// Does NOT perform permission checks.
+static void runtime_emit(Runtime *rt,const Message *src,Doer *d)
+{
+    Message m=*src;
+    counter_add(&runtime_shard(rt)->created,1);
+    m.id=mint_next_msg_id(rt);
+    TRACE(rt,TRACE_EMIT,m.id,d,0);
+    journal_record(&rt->journal,JREC_CREATED,&m,d);
+    if(!validate_capability(caps_current(rt),m.cap,d))
+    {
+        runtime_record_drop(&m, d, DROP_CAPABILITY_DENIED);
+    }
+    else if(!validate_kind(m.kind,d))
+    {
+        runtime_record_drop(&m, d, DROP_KIND_UNHANDLED);
+    }
+    else
+    {
+        Envelope *e=envelope_alloc(&m);
+        if(doer_deliver(d,e,m.id)!=0)
+            runtime_record_drop(&m, d, DROP_INBOX_FULL);
+        envelope_release(e);
+    }
+}
+// Delivers one Envelope to every member of a compiled group.
+// Capability validation is one AND per 64 members against the
+// group bitmap; each delivery still gets its own id and outcome.
+static void runtime_multicast(Runtime *rt,const Message *src,const uint64_t *members)
+{
+    CounterShard *c=runtime_shard(rt);
+    const CapabilitySet *cs=caps_current(rt);
+    const uint64_t *allowed=(src->cap>0&&src->cap<RULES_CAP_LIMIT) ? cs->doers[src->cap] : NULL;
+    Envelope *e=envelope_alloc(src);
+    for(int w=0;w<RULES_DOER_WORDS;w++)
+    {
+        uint64_t ok=allowed ? members[w]&allowed[w] : 0;
+        for(uint64_t bits=members[w];bits;bits&=bits-1)
+        {
+            int bit=__builtin_ctzll(bits);
+            Doer *d=&rt->doers[w*64+bit];
+            int id=mint_next_msg_id(rt);
+            counter_add(&c->created,1);
+            TRACE(rt,TRACE_EMIT,id,d,0);
+            if(journal_enabled(&rt->journal))
+            {
+                Message m=e->msg;
+                m.id=id;
+                journal_record(&rt->journal,JREC_CREATED,&m,d);
+            }
+            DropReason why=DROP_REASON_COUNT;
+            if(!((ok>>bit)&1))
+                why=DROP_CAPABILITY_DENIED;
+            else if(!validate_kind(e->msg.kind,d))
+                why=DROP_KIND_UNHANDLED;
+            else if(doer_deliver(d,e,id)!=0)
+                why=DROP_INBOX_FULL;
+            if(why!=DROP_REASON_COUNT)
+            {
+                Message m=e->msg;
+                m.id=id;
+                runtime_record_drop(&m,d,why);
+            }
+        }
+    }
+    envelope_release(e);
+}
+// === CONTENT ROUTING ===
+// Target set of a payload under the compiled match rules: the
+// automaton starts with the start-of-line symbol (prefix rules), then
+// takes one table step per byte, collecting targets as it goes.
+static uint64_t content_match(const char *payload)
+{
+    unsigned s=rules_match_next[0][RULES_MATCH_START];
+    uint64_t targets=rules_match_targets[s];
+    for(const unsigned char *p=(const unsigned char *)payload;*p;p++)
+    {
+        s=rules_match_next[s][rules_match_class[*p]];
+        targets|=rules_match_targets[s];
+    }
+    return targets;
+}
+static void runtime_route(Runtime *rt,const Message *msg);
+// Routes msg to every target its payload matches, each Doer once
+// however many of its targets matched; pool targets pick a member
+// each. A payload matching nothing goes to the boundary target.
+static void runtime_route_content(Runtime *rt,const Message *msg)
+{
+    Message m=*msg;
+    uint64_t targets=content_match(msg->payload);
+    if(!targets)
+    {
+        m.to=RULES_STDIN_TARGET;
+        runtime_route(rt,&m);
+        return;
+    }
+    uint64_t members[RULES_DOER_WORDS]={0};
+    unsigned long fanout=0;
+    int last=-1;
+    for(;targets;targets&=targets-1)
+    {
+        int t=__builtin_ctzll(targets);
+        if(rules_route_pool[t]>=0)
+        {
+            m.to=(Target)t;
+            runtime_route(rt,&m);
+            continue;
+        }
+        for(uint32_t i=rules_route_offset[t];i<rules_route_offset[t+1];i++)
+        {
+            uint32_t d=rules_route_doers[i];
+            fanout+=!((members[d/64]>>(d%64))&1);
+            members[d/64]|=1ull<<(d%64);
+            last=(int)d;
+        }
+    }
+    m.to=TARGET_BY_CONTENT;
+    if(!fanout||!admission_admit(rt,&m,fanout,"match")) return;
+    if(fanout==1)
+        runtime_emit(rt,&m,&rt->doers[last]);
+    else
+        runtime_multicast(rt,&m,members);
+}
+static void offload_capture(const Message *msg);
+// === RUNTIME ===
+// Executes already-validated actions.
+// Does NOT perform permission checks.
+static void runtime_route(Runtime *rt,const Message *msg)
+{
+    if(t_offload)
+    {
+        offload_capture(msg);
+        return;
+    }
+    if(msg->to==TARGET_BY_CONTENT)
+    {
+        runtime_route_content(rt,msg);
+        return;
+    }
+    if((unsigned)msg->to>=TARGET_COUNT)
+    {
+        runtime_record_refused(rt,msg,"?",DROP_NO_ROUTE);
+        return;
+    }
+    if(rules_route_pool[msg->to]>=0)
+    {
+        DoerPool *p=&rt->pools[rules_route_pool[msg->to]];
+        if(!admission_admit(rt,msg,1,p->name)) return;
+        Doer *d=pool_pick(p);
+        if(d)
+            runtime_emit(rt,msg,d);
+        else
+            runtime_record_refused(rt,msg,p->name,DROP_NO_ROUTE);
+        return;
+    }
+    if(!admission_admit(rt,msg,rules_route_offset[msg->to+1]-rules_route_offset[msg->to],
+                        rules_target_names[msg->to]))
+        return;
+    if(rules_route_group[msg->to]>=0)
+    {
+        runtime_multicast(rt,msg,rules_group_members[rules_route_group[msg->to]]);
+        return;
+    }
+    for(uint32_t i=rules_route_offset[msg->to];i<rules_route_offset[msg->to+1];i++)
+    {
+        runtime_emit(rt,msg,&rt->doers[rules_route_doers[i]]);
+    }
+}
+// === FUSION ===
+// cmrc links Doer X to Doer Y in rules_fused_next[] when X forwards to
+// Y alone, X is Y's only forwarding producer, both share an affinity
+// group and Y accepts every capability and kind X does. A Message X has
+// handled can then never be dropped at Y, so the hop needs no
+// validation, Envelope or inbox: runtime_forward parks it here and the
+// scheduler runs Y's handler right after X's (a trampoline, so long
+// chains do not nest). Each hop is still minted, counted and journaled.
+typedef struct{
+    Doer *d;
+    Message m;
+    int armed;
+}FusedHop;
+static _Thread_local FusedHop t_fused;
+// Passes a handled Message on to the Doer's forward target from the
+// rule file; a Doer without one is the end of its chain.
+static void runtime_forward(const Doer *self,const Message *msg)
+{
+    if(rules_forward[self->cap_slot]<0) return;
+    Message m=*msg;
+    m.to=(Target)rules_forward[self->cap_slot];
+    int32_t next=self->cap_slot<RULES_DOER_COUNT ? rules_fused_next[self->cap_slot] : -1;
+    if(next>=0&&!t_fused.armed&&!self->rt->doers[next].proxy&&!t_offload)
+    {
+        t_fused.d=&self->rt->doers[next];
+        t_fused.m=m;
+        t_fused.armed=1;
+        return;
+    }
+    runtime_route(self->rt,&m);
+}
+static void doer_stage(Doer *self,const Message *msg)
+{
+    printf("msg %d cap %d [%s]:%s\n",msg->id,msg->cap,self->name,msg->payload);
+    runtime_forward(self,msg);
+}
+// === TOPICS ===
+// Publish/subscribe over the normal emit path. Each topic holds an
+// immutable subscriber list behind an atomic pointer: publishers load
+// it and walk it without any lock; subscribe/unsubscribe copy the list,
+// swap the pointer and retire the old copy. Writers serialize among
+// themselves only, so they never stall a publisher.
+typedef struct SubscriberList{
+    struct SubscriberList *next_retired;
+    int count;
+    Doer *doers[];
+}SubscriberList;
+static SubscriberList *subscriber_list_new(int count)
+{
+    SubscriberList *l=malloc(sizeof(*l)+(size_t)count*sizeof(l->doers[0]));
+    if(!l)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    l->next_retired=NULL;
+    l->count=count;
+    return l;
+}
+static void topic_swap(Runtime *rt,Topic t,SubscriberList *next)
+{
+    SubscriberList *old=atomic_exchange_explicit(&rt->topic_subs[t],next,memory_order_acq_rel);
+    if(old)
+    {
+        old->next_retired=rt->topic_retired;
+        rt->topic_retired=old;
+    }
+}
+// Subscribing requires the topic's capability. Returns 0 on success,
+// -1 if the capability is missing (the request is rejected, not queued).
+static int runtime_subscribe(Runtime *rt,Topic t,Doer *d)
+{
+    offload_forbid("runtime_subscribe");
+    if((unsigned)t>=TOPIC_COUNT) return -1;
+    if(!validate_capability(caps_current(rt),rules_topic_cap[t],d))
+    {
+        printf("[SUBSCRIBE] denied topic=%s doer=%s cap=%d\n",rules_topic_names[t],d->name,rules_topic_cap[t]);
+        return -1;
+    }
+    pthread_mutex_lock(&rt->topic_writer);
+    SubscriberList *cur=atomic_load_explicit(&rt->topic_subs[t],memory_order_acquire);
+    int n=cur ? cur->count : 0;
+    for(int i=0;i<n;i++)
+    {
+        if(cur->doers[i]==d)
+        {
+            pthread_mutex_unlock(&rt->topic_writer);
+            return 0;
+        }
+    }
+    SubscriberList *next=subscriber_list_new(n+1);
+    if(n) memcpy(next->doers,cur->doers,(size_t)n*sizeof(next->doers[0]));
+    next->doers[n]=d;
+    topic_swap(rt,t,next);
+    pthread_mutex_unlock(&rt->topic_writer);
+    return 0;
+}
+// Returns 0 on success, -1 if d was not subscribed.
+static int runtime_unsubscribe(Runtime *rt,Topic t,Doer *d)
+{
+    offload_forbid("runtime_unsubscribe");
+    if((unsigned)t>=TOPIC_COUNT) return -1;
+    pthread_mutex_lock(&rt->topic_writer);
+    SubscriberList *cur=atomic_load_explicit(&rt->topic_subs[t],memory_order_acquire);
+    int n=cur ? cur->count : 0;
+    int at=-1;
+    for(int i=0;i<n;i++)
+    {
+        if(cur->doers[i]==d) at=i;
+    }
+    if(at>=0)
+    {
+        SubscriberList *next=subscriber_list_new(n-1);
+        memcpy(next->doers,cur->doers,(size_t)at*sizeof(next->doers[0]));
+        memcpy(next->doers+at,cur->doers+at+1,(size_t)(n-at-1)*sizeof(next->doers[0]));
+        topic_swap(rt,t,next);
+    }
+    pthread_mutex_unlock(&rt->topic_writer);
+    return at>=0 ? 0 : -1;
+}
+// Frees retired subscriber lists. Only call where no publish can be in
+// progress (between scheduler steps).
+static void topic_reclaim(Runtime *rt)
+{
+    pthread_mutex_lock(&rt->topic_writer);
+    SubscriberList *l=rt->topic_retired;
+    rt->topic_retired=NULL;
+    pthread_mutex_unlock(&rt->topic_writer);
+    while(l)
+    {
+        SubscriberList *next=l->next_retired;
+        free(l);
+        l=next;
+    }
+}
+// O(subscribers): every subscriber gets its own Message through
+// runtime_emit, so capability checks, drops and balance are unchanged.
+// A publish nobody is subscribed to still mints a Message and records
+// it as dropped: the input has an explicit outcome.
+static void runtime_publish(Runtime *rt,Topic t,const Message *msg)
+{
+    offload_forbid("runtime_publish");
+    if((unsigned)t>=TOPIC_COUNT)
+    {
+        runtime_record_refused(rt,msg,"?",DROP_NO_ROUTE);
+        return;
+    }
+    SubscriberList *subs=atomic_load_explicit(&rt->topic_subs[t],memory_order_acquire);
+    if(!subs||subs->count==0)
+    {
+        runtime_record_refused(rt,msg,rules_topic_names[t],DROP_NO_ROUTE);
+        return;
+    }
+    if(!admission_admit(rt,msg,(unsigned long)subs->count,rules_topic_names[t])) return;
+    for(int i=0;i<subs->count;i++)
+    {
+        runtime_emit(rt,msg,subs->doers[i]);
+    }
+}
+// === TIMER ===
+// Delayed delivery as an ordinary Doer. Doer T takes requests
+//   t DELAY_MS COMMAND   → deliver COMMAND (boundary syntax) later
+//   t cancel ID          → forget a pending timer
+// and keeps them in a hierarchical timing wheel: four levels of 256
+// one-millisecond slots plus an overflow list beyond 2^32 ms. An entry
+// sits at the lowest level whose slot group it shares with "now", so
+// insert and cancel are an O(1) list splice. Slots append at the tail
+// and cascade in order, so timers with one deadline fire in the order
+// they were armed. One timerfd is armed to
+// the next tick that has work (an expiry or a cascade), so the process
+// sleeps while nothing is due. Each expiry is routed as a normal
+// Message carrying the capability of the request that armed it.
+#define TIMER_LEVELS 4
+#define TIMER_SLOTS 256
+#define TIMER_NIL UINT32_MAX
+#define TIMER_MAX_DELAY_MS (1ull<<40)
+typedef struct{
+    uint64_t expires;   // tick, ms since timer_init
+    uint32_t prev;
+    uint32_t next;
+    uint32_t gen;       // bumped on free, so stale ids cannot cancel
+    int level;          // -1 while free
+    int slot;
+    Message msg;        // delivered on expiry
+    char *text;         // owns msg.payload
+}TimerEntry;
+typedef struct TimerWheel{
+    Runtime *rt;        // where expiries are routed
+    TimerEntry *e;
+    uint32_t cap;
+    uint32_t used;
+    uint32_t free_head;
+    // Level TIMER_LEVELS is the overflow list (slot 0 only).
+    uint32_t head[TIMER_LEVELS+1][TIMER_SLOTS];
+    uint32_t tail[TIMER_LEVELS+1][TIMER_SLOTS];
+    uint64_t occ[TIMER_LEVELS][TIMER_SLOTS/64];
+    uint64_t now;
+    uint64_t base_ns;
+    unsigned long pending;
+    int fd;
+    // Payloads of fired timers stay alive until the step has drained.
+    char **retired;
+    size_t retired_len;
+    size_t retired_cap;
+}TimerWheel;
+static void timer_init(TimerWheel *w,Runtime *rt)
+{
+    memset(w,0,sizeof(*w));
+    w->rt=rt;
+    memset(w->head,0xff,sizeof(w->head));
+    memset(w->tail,0xff,sizeof(w->tail));
+    w->free_head=TIMER_NIL;
+    w->base_ns=monotonic_ns();
+    w->fd=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC);
+    if(w->fd<0)
+    {
+        perror("timerfd");
+        exit(1);
+    }
+}
+static uint64_t timer_tick_now(const TimerWheel *w)
+{
+    return (monotonic_ns()-w->base_ns)/1000000u;
+}
+static void timer_link(TimerWheel *w,uint32_t i,int level,int slot)
+{
+    TimerEntry *e=&w->e[i];
+    e->level=level;
+    e->slot=slot;
+    e->next=TIMER_NIL;
+    e->prev=w->tail[level][slot];
+    if(e->prev!=TIMER_NIL) w->e[e->prev].next=i;
+    else w->head[level][slot]=i;
+    w->tail[level][slot]=i;
+    if(level<TIMER_LEVELS) w->occ[level][slot>>6]|=1ull<<(slot&63);
+}
+static void timer_unlink(TimerWheel *w,uint32_t i)
+{
+    TimerEntry *e=&w->e[i];
+    if(e->prev!=TIMER_NIL) w->e[e->prev].next=e->next;
+    else w->head[e->level][e->slot]=e->next;
+    if(e->next!=TIMER_NIL) w->e[e->next].prev=e->prev;
+    else w->tail[e->level][e->slot]=e->prev;
+    if(e->level<TIMER_LEVELS&&w->head[e->level][e->slot]==TIMER_NIL)
+        w->occ[e->level][e->slot>>6]&=~(1ull<<(e->slot&63));
+}
+static uint32_t timer_alloc(TimerWheel *w)
+{
+    if(w->free_head!=TIMER_NIL)
+    {
+        uint32_t i=w->free_head;
+        w->free_head=w->e[i].next;
+        return i;
+    }
+    if(w->used==w->cap)
+    {
+        uint32_t cap=w->cap ? w->cap*2 : 1024;
+        TimerEntry *e=realloc(w->e,(size_t)cap*sizeof(*e));
+        if(!e)
+        {
+            perror("malloc");
+            exit(1);
+        }
+        w->e=e;
+        w->cap=cap;
+    }
+    w->e[w->used].gen=0;
+    return w->used++;
+}
+static void timer_free(TimerWheel *w,uint32_t i)
+{
+    w->e[i].level=-1;
+    w->e[i].gen++;
+    w->e[i].next=w->free_head;
+    w->free_head=i;
+    w->pending--;
+}
+static void timer_fire(TimerWheel *w,uint32_t i)
+{
+    Message m=w->e[i].msg;
+    if(w->retired_len==w->retired_cap)
+    {
+        size_t cap=w->retired_cap ? w->retired_cap*2 : 64;
+        char **r=realloc(w->retired,cap*sizeof(*r));
+        if(!r)
+        {
+            perror("malloc");
+            exit(1);
+        }
+        w->retired=r;
+        w->retired_cap=cap;
+    }
+    w->retired[w->retired_len++]=w->e[i].text;
+    timer_free(w,i);
+    runtime_route(w->rt,&m);
+}
+// Files entry i relative to w->now; fires it when already due.
+static void timer_place(TimerWheel *w,uint32_t i)
+{
+    uint64_t t=w->e[i].expires;
+    if(t<=w->now)
+    {
+        timer_fire(w,i);
+        return;
+    }
+    int level=(63-__builtin_clzll(t^w->now))/8;
+    if(level>=TIMER_LEVELS) timer_link(w,i,TIMER_LEVELS,0);
+    else timer_link(w,i,level,(int)((t>>(8*level))&(TIMER_SLOTS-1)));
+}
+// First occupied slot after `after` in one level, or -1.
+static int timer_next_slot(const uint64_t *occ,int after)
+{
+    for(int s=after+1;s<TIMER_SLOTS;)
+    {
+        uint64_t m=occ[s>>6]&(~0ull<<(s&63));
+        if(m) return (s&~63)|__builtin_ctzll(m);
+        s=(s|63)+1;
+    }
+    return -1;
+}
+// Next tick at which an entry expires or a slot must cascade.
+static uint64_t timer_next_tick(const TimerWheel *w)
+{
+    uint64_t best=UINT64_MAX;
+    for(int k=0;k<TIMER_LEVELS;k++)
+    {
+        int s=timer_next_slot(w->occ[k],(int)((w->now>>(8*k))&(TIMER_SLOTS-1)));
+        if(s<0) continue;
+        uint64_t group=w->now&~((1ull<<(8*(k+1)))-1);
+        uint64_t t=group|((uint64_t)s<<(8*k));
+        if(t<best) best=t;
+    }
+    if(w->head[TIMER_LEVELS][0]!=TIMER_NIL)
+    {
+        uint64_t t=((w->now>>(8*TIMER_LEVELS))+1)<<(8*TIMER_LEVELS);
+        if(t<best) best=t;
+    }
+    return best;
+}
+static void timer_cascade(TimerWheel *w,int level,int slot)
+{
+    uint32_t i=w->head[level][slot];
+    w->head[level][slot]=TIMER_NIL;
+    w->tail[level][slot]=TIMER_NIL;
+    if(level<TIMER_LEVELS) w->occ[level][slot>>6]&=~(1ull<<(slot&63));
+    while(i!=TIMER_NIL)
+    {
+        uint32_t next=w->e[i].next;
+        timer_place(w,i);
+        i=next;
+    }
+}
+// Jumps from one tick with work to the next, up to `target`.
+static void timer_advance(TimerWheel *w,uint64_t target)
+{
+    while(w->pending)
+    {
+        uint64_t t=timer_next_tick(w);
+        if(t>target) break;
+        w->now=t;
+        if((t&((1ull<<(8*TIMER_LEVELS))-1))==0) timer_cascade(w,TIMER_LEVELS,0);
+        for(int k=TIMER_LEVELS-1;k>=1;k--)
+        {
+            if((t&((1ull<<(8*k))-1))==0) timer_cascade(w,k,(int)((t>>(8*k))&(TIMER_SLOTS-1)));
+        }
+        timer_cascade(w,0,(int)(t&(TIMER_SLOTS-1)));
+    }
+    if(target>w->now) w->now=target;
+}
+// Arms the timerfd at the next tick with work, or disarms it.
+static void timer_arm(TimerWheel *w)
+{
+    struct itimerspec its={0};
+    uint64_t t=w->pending ? timer_next_tick(w) : UINT64_MAX;
+    if(t!=UINT64_MAX)
+    {
+        uint64_t ns=w->base_ns+t*1000000u;
+        its.it_value.tv_sec=(time_t)(ns/1000000000u);
+        its.it_value.tv_nsec=(long)(ns%1000000000u);
+    }
+    timerfd_settime(w->fd,TFD_TIMER_ABSTIME,&its,NULL);
+}
+// Fires everything due by the current time; returns how many fired
+// (a wakeup may only cascade).
+static size_t timer_expire(TimerWheel *w)
+{
+    uint64_t expirations;
+    while(read(w->fd,&expirations,sizeof(expirations))>0){}
+    size_t before=w->retired_len;
+    timer_advance(w,timer_tick_now(w));
+    return w->retired_len-before;
+}
+static uint64_t timer_insert(TimerWheel *w,uint64_t delay_ms,const Message *m,char *text)
+{
+    offload_forbid("timer_insert");
+    // An empty wheel can jump straight to the present.
+    if(!w->pending) w->now=timer_tick_now(w);
+    uint32_t i=timer_alloc(w);
+    TimerEntry *e=&w->e[i];
+    e->expires=timer_tick_now(w)+delay_ms;
+    e->msg=*m;
+    e->text=text;
+    uint64_t id=((uint64_t)e->gen<<32)|i;
+    w->pending++;
+    timer_place(w,i);
+    return id;
+}
+static int timer_cancel(TimerWheel *w,uint64_t id)
+{
+    offload_forbid("timer_cancel");
+    uint32_t i=(uint32_t)id;
+    if(i>=w->used||w->e[i].gen!=(uint32_t)(id>>32)||w->e[i].level<0) return -1;
+    timer_unlink(w,i);
+    free(w->e[i].text);
+    timer_free(w,i);
+    return 0;
+}
+// Called once the step has drained: no inbox references a fired payload.
+static void timer_reclaim(TimerWheel *w)
+{
+    for(size_t i=0;i<w->retired_len;i++) free(w->retired[i]);
+    w->retired_len=0;
+}
+// Pending timers are discarded with the runtime.
+static void timer_destroy(TimerWheel *w)
+{
+    timer_reclaim(w);
+    for(uint32_t i=0;i<w->used;i++)
+    {
+        if(w->e[i].level>=0) free(w->e[i].text);
+    }
+    free(w->e);
+    free(w->retired);
+    if(w->fd>=0) close(w->fd);
+}
+static void doer_t_schedule(Doer *self,const Message *msg)
+{
+    TimerWheel *w=self->rt->timer;
+    const char *p=msg->payload;
+    char *end;
     while(*p==' '||*p=='\t') p++;
-    if(*p=='\0') return;
-    Message msg={
-        .to=TARGET_A,
-        .kind=MSGK_STDIN_LINE,
-        .cap=1,
+    if(strncmp(p,"cancel",6)==0&&(p[6]==' '||p[6]=='\t'))
+    {
+        uint64_t id=strtoull(p+7,&end,10);
+        if(end==p+7||timer_cancel(w,id)!=0)
+            printf("[TIMER] cancel failed id=%s\n",p+7);
+        else
+            printf("[TIMER] cancelled id=%llu pending=%lu\n",(unsigned long long)id,w->pending);
+        return;
+    }
+    uint64_t delay=strtoull(p,&end,10);
+    char *text=end!=p&&delay<=TIMER_MAX_DELAY_MS ? strdup(end) : NULL;
+    Message m={0};
+    if(!text||boundary_decode(text,strlen(text),&m)!=C2M_OK)
+    {
+        free(text);
+        printf("[TIMER] rejected request=\"%s\"\n",msg->payload);
+        return;
+    }
+    // The delayed Message carries the authority of the request.
+    m.cap=msg->cap;
+    uint64_t id=timer_insert(w,delay,&m,text);
+    printf("[TIMER] armed id=%llu delay_ms=%llu pending=%lu\n",
+           (unsigned long long)id,(unsigned long long)delay,w->pending);
+}
+// Runs d's handler for m: traced, and with -a charged to d and m's kind.
+static inline void doer_handle(Doer *d,const Message *m)
+{
+    Runtime *rt=d->rt;
+    uint64_t before[ACCT_COUNT];
+    TRACE(rt,TRACE_HANDLE_BEGIN,m->id,d,0);
+    if(rt->acct_enabled) acct_sample(before);
+    doer_dispatch(d,m);
+    if(rt->acct_enabled) acct_charge(&d->stats.cost[m->kind],before);
+    TRACE(rt,TRACE_HANDLE_END,m->id,d,0);
+}
+// Adds one member to a pool: a new Doer named "<pool>.<n>" with the
+// pool's handlers and capabilities, registered for scheduling.
+static Doer *runtime_add_pool_member(Runtime *rt,DoerPool *p)
+{
+    offload_forbid("runtime_add_pool_member");
+    Doer *d=aligned_alloc(_Alignof(Doer),sizeof(*d));
+    Doer **members=realloc(p->members,(size_t)(p->count+1)*sizeof(*members));
+    char *name=malloc(strlen(p->name)+16);
+    if(!d||!members||!name)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    memset(d,0,sizeof(*d));
+    p->members=members;
+    sprintf(name,"%s.%d",p->name,p->count);
+    d->rt=rt;
+    d->name=name;
+    d->cap_slot=p->cap_slot;
+    d->affinity=rt->next_affinity++;   // members spread over the workers
+    inbox_init(&d->inbox,rules_inbox_high[p->cap_slot],rules_inbox_low[p->cap_slot]);
+    if(registry_add(&rt->reg,d)!=0)
+    {
+        free(name);
+        free(d);
+        return NULL;
+    }
+    p->members[p->count++]=d;
+    return d;
+}
+// === NODES ===
+// Several scat10 processes running the same rule file form one CMR
+// over TCP. `-L [HOST:]PORT` accepts peers; `-R DOER=HOST:PORT` turns
+// rule Doer DOER into a proxy for the Doer of that name on the node
+// listening at HOST:PORT. Links to one node share a connection.
+// A Message delivered to a proxy has passed local validation; it is
+// serialized as a length-prefixed frame into the link's out buffer
+// (any thread, under the link lock), and at step end the driving
+// thread hands everything buffered to the kernel with one writev.
+// Incoming frames are input events like stdin lines: the payload
+// travels with its NUL and stays in the read buffer until the step
+// has drained, so a frame becomes an inbox slot without a copy. The
+// receiver validates again and acknowledges each read with its
+// cumulative count.
+// Until acknowledged a forwarded Message counts as pending on the
+// sender, afterwards as forwarded. Every node keeps
+//   created + received = handled + dropped + forwarded + pending
+// and at the end each link compares what was sent with what arrived.
+#define NODE_CHUNK (64u<<10)
+#define NODE_MAX_FRAME (16u<<20)
+#define NODE_MAX_CONNS 64
+#define NODE_MAX_IOV 64
+#define NODE_CONNECT_TRIES 50       // 100 ms apart: peers start together
+enum{
+    NODE_HELLO,                     // value: rule set hash
+    NODE_DATA,                      // value: origin id; payload + NUL
+    NODE_ACK,                       // value: DATA frames received so far
+    NODE_FIN                        // value: DATA frames sent in total
+};
+// Wire header, little-endian; len counts the bytes after it.
+typedef struct{
+    uint32_t len;
+    uint16_t type;
+    uint16_t doer;
+    int32_t cap;
+    int32_t kind;
+    uint64_t value;
+}NodeFrame;
+typedef struct NodeChunk{
+    struct NodeChunk *next;
+    uint32_t off;                   // written to the kernel so far
+    uint32_t len;
+    uint32_t cap;
+    char data[];
+}NodeChunk;
+typedef struct NodeConn{
+    struct NodeConn *next;
+    char name[64];                  // HOST:PORT or the peer's address
+    int fd;
+    int outgoing;                   // we connected: proxies send on it
+    pthread_mutex_t lock;           // guards pending and queued
+    NodeChunk *pending;             // appended by any thread
+    NodeChunk *pending_tail;
+    NodeChunk *sending;             // driving thread only
+    unsigned long queued;           // outgoing: DATA frames buffered
+    _Atomic unsigned long acked;    // outgoing: acknowledged by the peer
+    _Atomic unsigned long inflight; // outgoing: queued - acked, read lock-free
+    int fin_sent;
+    unsigned long received;         // incoming: DATA frames read
+    unsigned long fin_total;        // incoming: the peer's FIN count
+    int fin_seen;
+    int hello_seen;
+    char *buf;                      // read buffer
+    size_t off;
+    size_t len;
+    size_t cap;
+}NodeConn;
+typedef struct Node{
+    int listen_fd;
+    int peers_seen;
+    uint64_t rules_hash;
+    _Atomic(NodeConn *) conns;  // grows on accept; the metrics thread walks it
+    int conn_count;
+}Node;
+// FNV-1a over what both ends must agree on: targets, Doer slots and
+// the compiled capability image.
+static uint64_t node_rules_hash(void)
+{
+    uint64_t h=0xcbf29ce484222325ull;
+#define NODE_HASH_BYTES(p_,n_) \
+    for(size_t k_=0;k_<(size_t)(n_);k_++) h=(h^((const unsigned char *)(p_))[k_])*0x100000001b3ull;
+    for(int t=0;t<TARGET_COUNT;t++) NODE_HASH_BYTES(rules_target_names[t],strlen(rules_target_names[t])+1)
+#define RULES_DOER_HASH(slot_,name_) NODE_HASH_BYTES(name_,strlen(name_)+1)
+    RULES_DOERS(RULES_DOER_HASH)
+#undef RULES_DOER_HASH
+    NODE_HASH_BYTES(rules_cap_doers,sizeof(rules_cap_doers))
+#undef NODE_HASH_BYTES
+    return h;
+}
+static void node_frame_encode(char *dst,const NodeFrame *f)
+{
+    NodeFrame w={
+        .len=htole32(f->len),
+        .type=htole16(f->type),
+        .doer=htole16(f->doer),
+        .cap=(int32_t)htole32((uint32_t)f->cap),
+        .kind=(int32_t)htole32((uint32_t)f->kind),
+        .value=htole64(f->value)
+    };
+    memcpy(dst,&w,sizeof(w));
+}
+static void node_frame_decode(NodeFrame *f,const char *src)
+{
+    memcpy(f,src,sizeof(*f));
+    f->len=le32toh(f->len);
+    f->type=le16toh(f->type);
+    f->doer=le16toh(f->doer);
+    f->cap=(int32_t)le32toh((uint32_t)f->cap);
+    f->kind=(int32_t)le32toh((uint32_t)f->kind);
+    f->value=le64toh(f->value);
+}
+// Appends one frame to c's pending chunks. Caller holds c->lock.
+static void node_append(NodeConn *c,const NodeFrame *f,const char *payload,size_t plen)
+{
+    size_t need=sizeof(*f)+plen;
+    NodeChunk *k=c->pending_tail;
+    if(!k||k->cap-k->len<need)
+    {
+        size_t cap=need>NODE_CHUNK ? need : NODE_CHUNK;
+        k=malloc(sizeof(*k)+cap);
+        if(!k)
+        {
+            perror("malloc");
+            exit(1);
+        }
+        k->next=NULL;
+        k->off=k->len=0;
+        k->cap=(uint32_t)cap;
+        if(c->pending_tail) c->pending_tail->next=k;
+        else c->pending=k;
+        c->pending_tail=k;
+    }
+    node_frame_encode(k->data+k->len,f);
+    if(plen) memcpy(k->data+k->len+sizeof(*f),payload,plen);
+    k->len+=(uint32_t)need;
+}
+static void node_send_control(NodeConn *c,int type,uint64_t value)
+{
+    NodeFrame f={.type=(uint16_t)type,.value=value};
+    pthread_mutex_lock(&c->lock);
+    node_append(c,&f,NULL,0);
+    pthread_mutex_unlock(&c->lock);
+}
+// doer_deliver for a proxy: the Message leaves through its link. After
+// the link has finished it has no route any more.
+static void node_forward(Doer *d,Envelope *e,int id)
+{
+    NodeConn *c=d->proxy;
+    NodeFrame f={
+        .len=e->payload_len+1,
+        .type=NODE_DATA,
+        .doer=(uint16_t)d->slot,
+        .cap=e->msg.cap,
+        .kind=(int32_t)e->msg.kind,
+        .value=(uint64_t)id
+    };
+    pthread_mutex_lock(&c->lock);
+    int open=!c->fin_sent;
+    if(open)
+    {
+        node_append(c,&f,e->msg.payload ? e->msg.payload : "",f.len);
+        c->queued++;
+        atomic_fetch_add_explicit(&c->inflight,1,memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&c->lock);
+    if(!open)
+    {
+        Message m=e->msg;
+        m.id=id;
+        runtime_record_drop(&m,d,DROP_NO_ROUTE);
+    }
+}
+static void node_close(NodeConn *c,const char *why)
+{
+    if(c->fd<0) return;
+    if(why) printf("[NODE] closed %s: %s\n",c->name,why);
+    close(c->fd);
+    c->fd=-1;
+}
+// Hands c's buffered frames to the kernel, as far as it takes them.
+// Driving thread only.
+static void node_write(NodeConn *c)
+{
+    pthread_mutex_lock(&c->lock);
+    if(c->pending)
+    {
+        NodeChunk **tail=&c->sending;
+        while(*tail) tail=&(*tail)->next;
+        *tail=c->pending;
+        c->pending=c->pending_tail=NULL;
+    }
+    pthread_mutex_unlock(&c->lock);
+    while(c->sending&&c->fd>=0)
+    {
+        struct iovec iov[NODE_MAX_IOV];
+        int n=0;
+        for(NodeChunk *k=c->sending;k&&n<NODE_MAX_IOV;k=k->next)
+            iov[n++]=(struct iovec){.iov_base=k->data+k->off,.iov_len=k->len-k->off};
+        ssize_t w=writev(c->fd,iov,n);
+        if(w<0)
+        {
+            if(errno==EINTR) continue;
+            if(errno!=EAGAIN&&errno!=EWOULDBLOCK) node_close(c,strerror(errno));
+            return;
+        }
+        while(w>0)
+        {
+            NodeChunk *k=c->sending;
+            size_t left=k->len-k->off;
+            if((size_t)w<left)
+            {
+                k->off+=(uint32_t)w;
+                break;
+            }
+            w-=(ssize_t)left;
+            c->sending=k->next;
+            free(k);
+        }
+    }
+}
+static int node_has_output(NodeConn *c)
+{
+    pthread_mutex_lock(&c->lock);
+    int more=c->sending||c->pending;
+    pthread_mutex_unlock(&c->lock);
+    return more;
+}
+// A received DATA frame: validated like runtime_emit, but counted as
+// received rather than created, and always queued here, even for a
+// Doer that is a proxy on this node too (no forwarding loops). p stays
+// valid until the step drains.
+static void node_deliver(Runtime *rt,NodeConn *c,const NodeFrame *f,char *p)
+{
+    c->received++;
+    atomic_fetch_add_explicit(&rt->node_received,1,memory_order_relaxed);
+    Message m={
+        .id=mint_next_msg_id(rt),
+        .cap=f->cap,
+        .kind=(MessageKind)f->kind,
         .payload=p
     };
-    runtime_route(&msg);
+    Doer *d=&rt->doers[f->doer];
+    TRACE(rt,TRACE_EMIT,m.id,d,0);
+    if(!validate_capability(caps_current(rt),m.cap,d))
+        runtime_record_drop(&m,d,DROP_CAPABILITY_DENIED);
+    else if(!validate_kind(m.kind,d))
+        runtime_record_drop(&m,d,DROP_KIND_UNHANDLED);
+    else
+    {
+        Envelope *e=envelope_alloc(&m);
+        if(doer_deliver_inbox(d,e,m.id)!=0)
+            runtime_record_drop(&m,d,DROP_INBOX_FULL);
+        envelope_release(e);
+    }
+}
+static unsigned long node_queued(NodeConn *c)
+{
+    pthread_mutex_lock(&c->lock);
+    unsigned long queued=c->queued;
+    pthread_mutex_unlock(&c->lock);
+    return queued;
+}
+// Reads what c has and handles every complete frame. Returns how many
+// Messages were delivered. Between steps only: compacting the buffer
+// moves the payloads of the previous read.
+static int node_read(Runtime *rt,NodeConn *c)
+{
+    if(c->off)
+    {
+        memmove(c->buf,c->buf+c->off,c->len-c->off);
+        c->len-=c->off;
+        c->off=0;
+    }
+    if(c->cap-c->len<NODE_CHUNK)
+    {
+        size_t cap=c->cap ? c->cap*2 : 4*NODE_CHUNK;
+        char *buf=realloc(c->buf,cap);
+        if(!buf)
+        {
+            perror("malloc");
+            exit(1);
+        }
+        c->buf=buf;
+        c->cap=cap;
+    }
+    ssize_t r=read(c->fd,c->buf+c->len,c->cap-c->len);
+    if(r<0)
+    {
+        if(errno!=EINTR&&errno!=EAGAIN&&errno!=EWOULDBLOCK) node_close(c,strerror(errno));
+        return 0;
+    }
+    if(r==0)
+    {
+        node_close(c,c->fin_sent||c->fin_seen ? NULL : "peer went away");
+        return 0;
+    }
+    c->len+=(size_t)r;
+    int delivered=0;
+    while(c->len-c->off>=sizeof(NodeFrame))
+    {
+        NodeFrame f;
+        node_frame_decode(&f,c->buf+c->off);
+        if(f.len>NODE_MAX_FRAME)
+        {
+            node_close(c,"oversized frame");
+            return delivered;
+        }
+        if(c->len-c->off<sizeof(f)+f.len) break;
+        char *p=c->buf+c->off+sizeof(f);
+        c->off+=sizeof(f)+f.len;
+        if(!c->hello_seen&&!c->outgoing)
+        {
+            if(f.type!=NODE_HELLO||f.value!=rt->node->rules_hash)
+            {
+                node_close(c,"rule set differs");
+                return delivered;
+            }
+            c->hello_seen=1;
+            continue;
+        }
+        // Counts are checked against what this end has seen: an ACK
+        // for more than was sent would make the balance lie, and every
+        // DATA frame a FIN counts came before it on the stream.
+        if(f.type==NODE_DATA&&!c->outgoing&&!c->fin_seen&&f.doer<RULES_DOER_COUNT
+           &&(uint32_t)f.kind<MSGK_COUNT&&f.len>0&&p[f.len-1]=='\0')
+        {
+            node_deliver(rt,c,&f,p);
+            delivered++;
+        }
+        else if(f.type==NODE_ACK&&c->outgoing
+                &&f.value>=atomic_load_explicit(&c->acked,memory_order_relaxed)
+                &&f.value<=node_queued(c))
+        {
+            unsigned long acked=atomic_load_explicit(&c->acked,memory_order_relaxed);
+            atomic_store_explicit(&c->acked,(unsigned long)f.value,memory_order_relaxed);
+            atomic_fetch_add_explicit(&rt->node_forwarded,(unsigned long)f.value-acked,memory_order_relaxed);
+            atomic_fetch_sub_explicit(&c->inflight,(unsigned long)f.value-acked,memory_order_relaxed);
+        }
+        else if(f.type==NODE_FIN&&!c->outgoing&&!c->fin_seen&&f.value==c->received)
+        {
+            c->fin_seen=1;
+            c->fin_total=(unsigned long)f.value;
+        }
+        else
+        {
+            node_close(c,"protocol error");
+            return delivered;
+        }
+    }
+    if(delivered) node_send_control(c,NODE_ACK,c->received);
+    return delivered;
+}
+static NodeConn *node_conn_new(Node *n,int fd,const char *name,int outgoing)
+{
+    NodeConn *c=calloc(1,sizeof(*c));
+    if(!c)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    fcntl(fd,F_SETFL,fcntl(fd,F_GETFL)|O_NONBLOCK);
+    setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&(int){1},sizeof(int));
+    c->fd=fd;
+    c->outgoing=outgoing;
+    snprintf(c->name,sizeof(c->name),"%s",name);
+    pthread_mutex_init(&c->lock,NULL);
+    c->next=n->conns;
+    n->conns=c;
+    n->conn_count++;
+    return c;
+}
+static Node *node_get(Runtime *rt)
+{
+    if(!rt->node)
+    {
+        rt->node=calloc(1,sizeof(*rt->node));
+        if(!rt->node)
+        {
+            perror("malloc");
+            exit(1);
+        }
+        rt->node->listen_fd=-1;
+        rt->node->rules_hash=node_rules_hash();
+    }
+    return rt->node;
+}
+// "[HOST:]PORT" → IPv4 address; HOST defaults to any (listen) or
+// localhost (connect).
+static int node_parse_addr(const char *spec,int listening,struct sockaddr_in *sa)
+{
+    char host[64]="";
+    const char *port=strrchr(spec,':');
+    if(port)
+    {
+        if((size_t)(port-spec)>=sizeof(host)) return -1;
+        memcpy(host,spec,(size_t)(port-spec));
+        host[port-spec]='\0';
+        port++;
+    }
+    else
+        port=spec;
+    char *end;
+    long p=strtol(port,&end,10);
+    if(*end||p<=0||p>65535) return -1;
+    memset(sa,0,sizeof(*sa));
+    sa->sin_family=AF_INET;
+    sa->sin_port=htons((uint16_t)p);
+    if(!host[0]) sa->sin_addr.s_addr=htonl(listening ? INADDR_ANY : INADDR_LOOPBACK);
+    else if(strcmp(host,"localhost")==0) sa->sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+    else if(inet_pton(AF_INET,host,&sa->sin_addr)!=1) return -1;
+    return 0;
+}
+static int node_listen(Runtime *rt,const char *spec)
+{
+    struct sockaddr_in sa;
+    if(node_parse_addr(spec,1,&sa)!=0) return -1;
+    int fd=socket(AF_INET,SOCK_STREAM|SOCK_CLOEXEC,0);
+    if(fd<0) return -1;
+    setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&(int){1},sizeof(int));
+    if(bind(fd,(struct sockaddr *)&sa,sizeof(sa))!=0||listen(fd,16)!=0)
+    {
+        close(fd);
+        return -1;
+    }
+    node_get(rt)->listen_fd=fd;
+    return 0;
+}
+static void node_accept(Runtime *rt)
+{
+    struct sockaddr_in sa;
+    socklen_t len=sizeof(sa);
+    int fd=accept4(rt->node->listen_fd,(struct sockaddr *)&sa,&len,SOCK_CLOEXEC);
+    if(fd<0) return;
+    if(rt->node->conn_count==NODE_MAX_CONNS)
+    {
+        close(fd);
+        return;
+    }
+    char name[64],ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET,&sa.sin_addr,ip,sizeof(ip));
+    snprintf(name,sizeof(name),"%s:%u",ip,ntohs(sa.sin_port));
+    node_conn_new(rt->node,fd,name,0);
+    rt->node->peers_seen++;
+}
+// "DOER=HOST:PORT": DOER's Messages go to the node at HOST:PORT.
+// Connects (retrying while the peer starts) on first use of a peer.
+// Between steps only.
+static int node_proxy(Runtime *rt,const char *spec)
+{
+    const char *eq=strchr(spec,'=');
+    if(!eq) return -1;
+    Doer *d=NULL;
+    for(int i=0;i<RULES_DOER_COUNT;i++)
+    {
+        if(strlen(rt->doers[i].name)==(size_t)(eq-spec)&&strncmp(rt->doers[i].name,spec,(size_t)(eq-spec))==0)
+            d=&rt->doers[i];
+    }
+    struct sockaddr_in sa;
+    if(!d||node_parse_addr(eq+1,0,&sa)!=0) return -1;
+    Node *n=node_get(rt);
+    for(NodeConn *c=n->conns;c;c=c->next)
+    {
+        if(c->outgoing&&strcmp(c->name,eq+1)==0)
+        {
+            d->proxy=c;
+            return 0;
+        }
+    }
+    if(n->conn_count==NODE_MAX_CONNS) return -1;
+    for(int attempt=0;attempt<NODE_CONNECT_TRIES;attempt++)
+    {
+        int fd=socket(AF_INET,SOCK_STREAM|SOCK_CLOEXEC,0);
+        if(fd<0) return -1;
+        if(connect(fd,(struct sockaddr *)&sa,sizeof(sa))==0)
+        {
+            d->proxy=node_conn_new(n,fd,eq+1,1);
+            node_send_control(d->proxy,NODE_HELLO,n->rules_hash);
+            return 0;
+        }
+        close(fd);
+        if(errno!=ECONNREFUSED) return -1;
+        nanosleep(&(struct timespec){.tv_nsec=100000000},NULL);
+    }
+    return -1;
+}
+// Forwarded Messages the peers have not acknowledged yet. Lock-free:
+// the metrics thread calls it too.
+static unsigned long node_inflight(Runtime *rt)
+{
+    unsigned long n=0;
+    if(!rt->node) return 0;
+    for(NodeConn *c=rt->node->conns;c;c=c->next)
+        n+=atomic_load_explicit(&c->inflight,memory_order_relaxed);
+    return n;
+}
+// Step end: write out everything the step buffered.
+static void node_flush(Runtime *rt)
+{
+    if(!rt->node) return;
+    for(NodeConn *c=rt->node->conns;c;c=c->next) node_write(c);
+}
+// Input is over. Finishes outgoing links (FIN once everything is
+// acknowledged, then close) and reports whether every link is done:
+// ours closed, and every peer that connected has closed too. A node
+// that listens waits for at least one peer.
+static int node_finished(Runtime *rt)
+{
+    Node *n=rt->node;
+    if(!n) return 1;
+    int done=n->listen_fd<0||n->peers_seen>0;
+    for(NodeConn *c=n->conns;c;c=c->next)
+    {
+        if(c->fd<0) continue;
+        if(c->outgoing)
+        {
+            pthread_mutex_lock(&c->lock);
+            int fin=!c->fin_sent;
+            unsigned long queued=c->queued;
+            if(fin)
+            {
+                c->fin_sent=1;
+                NodeFrame f={.type=NODE_FIN,.value=queued};
+                node_append(c,&f,NULL,0);
+            }
+            pthread_mutex_unlock(&c->lock);
+            node_write(c);
+            if(atomic_load_explicit(&c->acked,memory_order_relaxed)==queued&&!node_has_output(c))
+                node_close(c,NULL);
+        }
+        if(c->fd>=0) done=0;
+    }
+    return done;
+}
+// pfd[] gets the listening socket and every open connection; returns
+// how many entries were filled.
+static int node_poll_fill(Runtime *rt,struct pollfd *pfd,int max)
+{
+    Node *n=rt->node;
+    int k=0;
+    if(!n) return 0;
+    if(n->listen_fd>=0&&k<max) pfd[k++]=(struct pollfd){.fd=n->listen_fd,.events=POLLIN};
+    for(NodeConn *c=n->conns;c&&k<max;c=c->next)
+    {
+        if(c->fd<0) continue;
+        pfd[k++]=(struct pollfd){.fd=c->fd,.events=POLLIN|(node_has_output(c) ? POLLOUT : 0)};
+    }
+    return k;
+}
+// Returns whether Messages arrived (an input event for the step).
+static int node_poll_handle(Runtime *rt,const struct pollfd *pfd,int count)
+{
+    Node *n=rt->node;
+    int delivered=0;
+    for(int i=0;i<count;i++)
+    {
+        if(!pfd[i].revents) continue;
+        if(pfd[i].fd==n->listen_fd)
+        {
+            node_accept(rt);
+            continue;
+        }
+        for(NodeConn *c=n->conns;c;c=c->next)
+        {
+            if(c->fd!=pfd[i].fd) continue;
+            if(pfd[i].revents&POLLOUT) node_write(c);
+            if(c->fd>=0&&(pfd[i].revents&(POLLIN|POLLHUP|POLLERR))) delivered+=node_read(rt,c);
+            break;
+        }
+    }
+    return delivered>0;
+}
+// [LINK] lines: per outgoing link what was sent and acknowledged, per
+// incoming link what arrived against the sender's FIN count. Returns
+// the number of links that do not balance.
+static int node_report(Runtime *rt)
+{
+    int bad=0;
+    if(!rt->node) return 0;
+    for(NodeConn *c=rt->node->conns;c;c=c->next)
+    {
+        if(c->outgoing)
+        {
+            unsigned long acked=atomic_load_explicit(&c->acked,memory_order_relaxed);
+            int ok=acked==c->queued;
+            printf("[LINK] to=%s sent=%lu acked=%lu %s\n",c->name,c->queued,acked,ok ? "ok" : "in_flight");
+            bad+=!ok;
+        }
+        else
+        {
+            int ok=c->fin_seen&&c->fin_total==c->received;
+            printf("[LINK] from=%s received=%lu peer_sent=%lu %s\n",c->name,c->received,
+                   c->fin_seen ? c->fin_total : 0,ok ? "ok" : "MISMATCH");
+            bad+=!ok;
+        }
+    }
+    return bad;
+}
+static void node_free(Runtime *rt)
+{
+    Node *n=rt->node;
+    if(!n) return;
+    if(n->listen_fd>=0) close(n->listen_fd);
+    while(n->conns)
+    {
+        NodeConn *c=n->conns;
+        n->conns=c->next;
+        node_close(c,NULL);
+        for(NodeChunk *k=c->pending;k;)
+        {
+            NodeChunk *next=k->next;
+            free(k);
+            k=next;
+        }
+        for(NodeChunk *k=c->sending;k;)
+        {
+            NodeChunk *next=k->next;
+            free(k);
+            k=next;
+        }
+        pthread_mutex_destroy(&c->lock);
+        free(c->buf);
+        free(c);
+    }
+    free(n);
+    rt->node=NULL;
+}
+// === RUNTIME ===
+static int scheduler_has_work(Runtime *rt)
+{
+    for(int i=0;i<rt->reg.count;i++)
+    {
+        Doer *d=rt->reg.list[i];
+        if(doer_has_work(d)){return 1;}
+    }
+    return 0;
+}
+// Queued in inboxes, plus forwarded to other nodes and not yet
+// acknowledged.
+static unsigned long runtime_pending_messages(Runtime *rt)
+{
+    const DoerRegistry *reg=&rt->reg;
+    unsigned long n = node_inflight(rt)+atomic_load(&rt->offload_pending);
+    for (int i = 0; i < reg->count; i++) {
+        n += doer_depth(reg->list[i]);
+    }
+    return n;
+}
+static long runtime_print_message_balance(Runtime *rt)
+{
+    unsigned long pending = runtime_pending_messages(rt);
+    unsigned long received = atomic_load_explicit(&rt->node_received,memory_order_relaxed);
+    unsigned long forwarded = atomic_load_explicit(&rt->node_forwarded,memory_order_relaxed);
+    long balance = (long)COUNTER_TOTAL(rt,created)
+                 + (long)received
+                 - (long)COUNTER_TOTAL(rt,handled)
+                 - (long)COUNTER_TOTAL(rt,dropped)
+                 - (long)forwarded
+                 - (long)pending;
+    if(rt->node)
+    {
+        printf("[MSG_BALANCE] created=%lu received=%lu enqueued=%lu handled=%lu dropped=%lu forwarded=%lu pending=%lu balance=%ld\n",
+           COUNTER_TOTAL(rt,created), received, COUNTER_TOTAL(rt,enqueued), COUNTER_TOTAL(rt,handled),
+           COUNTER_TOTAL(rt,dropped), forwarded, pending, balance);
+        return balance;
+    }
+    printf("[MSG_BALANCE] created=%lu enqueued=%lu handled=%lu dropped=%lu pending=%lu balance=%ld\n",
+       COUNTER_TOTAL(rt,created), COUNTER_TOTAL(rt,enqueued), COUNTER_TOTAL(rt,handled), COUNTER_TOTAL(rt,dropped),pending, balance);
+    return balance;
+}
+// -a: one [COST] line per (Doer, kind) that handled anything, most
+// expensive first. share is the part of all handler ticks; perf
+// counters the kernel refused are left out.
+typedef struct{
+    const Doer *d;
+    int kind;
+    unsigned long v[ACCT_COUNT+1];      // handled, then the costs
+}CostRow;
+static int cost_row_cmp(const void *a,const void *b)
+{
+    const CostRow *x=a,*y=b;
+    unsigned long tx=x->v[1+ACCT_TICKS],ty=y->v[1+ACCT_TICKS];
+    return tx<ty ? 1 : tx>ty ? -1 : 0;
+}
+static void runtime_print_costs(Runtime *rt)
+{
+    const DoerRegistry *reg=&rt->reg;
+    if(!rt->acct_enabled) return;
+    CostRow *rows=malloc((size_t)(reg->count ? reg->count : 1)*MSGK_COUNT*sizeof(*rows));
+    if(!rows)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    int n=0;
+    unsigned long total=0;
+    for(int i=0;i<reg->count;i++)
+    {
+        for(int k=0;k<MSGK_COUNT;k++)
+        {
+            KindCost *c=&reg->list[i]->stats.cost[k];
+            CostRow *r=&rows[n];
+            r->d=reg->list[i];
+            r->kind=k;
+            r->v[0]=counter_get(&c->handled);
+            if(!r->v[0]) continue;
+            for(int a=0;a<ACCT_COUNT;a++) r->v[1+a]=counter_get(&c->value[a]);
+            total+=r->v[1+ACCT_TICKS];
+            n++;
+        }
+    }
+    qsort(rows,(size_t)n,sizeof(*rows),cost_row_cmp);
+    for(int i=0;i<n;i++)
+    {
+        const CostRow *r=&rows[i];
+        printf("[COST] doer=%s kind=%s handled=%lu share=%.1f%%",r->d->name,rules_kind_names[r->kind],
+               r->v[0],total ? 100.0*(double)r->v[1+ACCT_TICKS]/(double)total : 0.0);
+        for(int a=0;a<ACCT_COUNT;a++)
+        {
+            if(a==ACCT_TICKS||atomic_load_explicit(&g_acct_available[a],memory_order_relaxed))
+                printf(" %s_per_msg=%.0f",acct_names[a],(double)r->v[1+a]/(double)r->v[0]);
+        }
+        printf("\n");
+    }
+    free(rows);
+}
+// Per-reason totals for the edge and each Doer that dropped anything.
+static void runtime_print_drops(Runtime *rt)
+{
+    const DoerRegistry *reg=&rt->reg;
+    drop_log_summary(&rt->drop_log);
+    for(int i=-1;i<reg->count;i++)
+    {
+        DropCounters *c=i<0 ? &rt->drop_edge : &reg->list[i]->drops;
+        const char *name=i<0 ? "(edge)" : reg->list[i]->name;
+        unsigned long v[DROP_REASON_COUNT],total=0;
+        for(int r=0;r<DROP_REASON_COUNT;r++)
+        {
+            v[r]=atomic_load_explicit(&(*c)[r],memory_order_relaxed);
+            total+=v[r];
+        }
+        if(!total) continue;
+        printf("[DROPS] doer=%s",name);
+        for(int r=0;r<DROP_REASON_COUNT;r++)
+        {
+            if(v[r]) printf(" %s=%lu",drop_reason_names[r],v[r]);
+        }
+        printf("\n");
+    }
+}
+// === METRICS ===
+// A side thread serves Prometheus text on a UNIX socket. It only loads
+// relaxed counters (global and per-Doer shards), so the scheduler never
+// waits for it; values read while Messages are in flight may be a few
+// deliveries apart from each other.
+typedef struct{
+    Runtime *rt;
+    const char *path;
+    int fd;
+    pthread_t thread;
+    uint64_t last_ns;
+    unsigned long last_handled;
+}MetricsServer;
+static void metrics_write(MetricsServer *ms,FILE *f)
+{
+    Runtime *rt=ms->rt;
+    const DoerRegistry *reg=&rt->reg;
+    unsigned long handled=COUNTER_TOTAL(rt,handled);
+    unsigned long dropped=COUNTER_TOTAL(rt,dropped);
+    unsigned long enqueued=COUNTER_TOTAL(rt,enqueued);
+    unsigned long created=COUNTER_TOTAL(rt,created);
+    unsigned long received=atomic_load_explicit(&rt->node_received,memory_order_relaxed);
+    unsigned long forwarded=atomic_load_explicit(&rt->node_forwarded,memory_order_relaxed);
+    unsigned long pending=runtime_pending_messages(rt);
+    uint64_t now=monotonic_ns();
+    double rate=0;
+    if(ms->last_ns&&now>ms->last_ns)
+        rate=(double)(handled-ms->last_handled)*1e9/(double)(now-ms->last_ns);
+    ms->last_ns=now;
+    ms->last_handled=handled;
+    fprintf(f,"# TYPE cmr_messages_created_total counter\ncmr_messages_created_total %lu\n",created);
+    fprintf(f,"# TYPE cmr_messages_enqueued_total counter\ncmr_messages_enqueued_total %lu\n",enqueued);
+    fprintf(f,"# TYPE cmr_messages_handled_total counter\ncmr_messages_handled_total %lu\n",handled);
+    fprintf(f,"# TYPE cmr_messages_dropped_total counter\ncmr_messages_dropped_total %lu\n",dropped);
+    fprintf(f,"# TYPE cmr_messages_pending gauge\ncmr_messages_pending %lu\n",pending);
+    fprintf(f,"# TYPE cmr_message_balance gauge\ncmr_message_balance %ld\n",
+            (long)created+(long)received-(long)handled-(long)dropped-(long)forwarded-(long)pending);
+    fprintf(f,"# TYPE cmr_handled_per_second gauge\ncmr_handled_per_second %.3f\n",rate);
+    fprintf(f,"# TYPE cmr_inbox_depth gauge\n");
+    for(int i=0;i<reg->count;i++)
+    {
+        Inbox *q=&reg->list[i]->inbox;
+        fprintf(f,"cmr_inbox_depth{doer=\"%s\"} %lu\n",reg->list[i]->name,
+                counter_get(&q->pushed)-counter_get(&q->popped));
+    }
+    fprintf(f,"# TYPE cmr_inbox_segments gauge\n");
+    for(int i=0;i<reg->count;i++)
+    {
+        fprintf(f,"cmr_inbox_segments{doer=\"%s\"} %lu\n",reg->list[i]->name,
+                counter_get(&reg->list[i]->inbox.segments));
+    }
+    fprintf(f,"# TYPE cmr_inbox_segments_allocated gauge\ncmr_inbox_segments_allocated %lu\n",
+            atomic_load_explicit(&g_seg_allocated,memory_order_relaxed));
+    fprintf(f,"# TYPE cmr_doer_handled_total counter\n");
+    for(int i=0;i<reg->count;i++)
+    {
+        fprintf(f,"cmr_doer_handled_total{doer=\"%s\"} %lu\n",reg->list[i]->name,
+                counter_get(&reg->list[i]->stats.handled));
+    }
+    fprintf(f,"# TYPE cmr_drops_total counter\n");
+    for(int i=-1;i<reg->count;i++)
+    {
+        DropCounters *c=i<0 ? &rt->drop_edge : &reg->list[i]->drops;
+        const char *name=i<0 ? "(edge)" : reg->list[i]->name;
+        for(int r=0;r<DROP_REASON_COUNT;r++)
+        {
+            unsigned long v=atomic_load_explicit(&(*c)[r],memory_order_relaxed);
+            if(v) fprintf(f,"cmr_drops_total{doer=\"%s\",reason=\"%s\"} %lu\n",name,drop_reason_names[r],v);
+        }
+    }
+    fprintf(f,"# TYPE cmr_handle_latency_seconds histogram\n");
+    for(int i=0;i<reg->count;i++)
+    {
+        DoerStats *st=&reg->list[i]->stats;
+        unsigned long cum=0;
+        for(int b=0;b<LATENCY_BUCKETS;b++)
+        {
+            cum+=counter_get(&st->latency[b]);
+            if(b==LATENCY_BUCKETS-1)
+                fprintf(f,"cmr_handle_latency_seconds_bucket{doer=\"%s\",le=\"+Inf\"} %lu\n",reg->list[i]->name,cum);
+            else
+                fprintf(f,"cmr_handle_latency_seconds_bucket{doer=\"%s\",le=\"%g\"} %lu\n",reg->list[i]->name,
+                        (double)(1ull<<(b+LATENCY_SHIFT))/1e9,cum);
+        }
+        fprintf(f,"cmr_handle_latency_seconds_sum{doer=\"%s\"} %g\n",reg->list[i]->name,
+                (double)counter_get(&st->latency_sum_ns)/1e9);
+        fprintf(f,"cmr_handle_latency_seconds_count{doer=\"%s\"} %lu\n",reg->list[i]->name,cum);
+    }
+    for(int a=0;a<ACCT_COUNT&&rt->acct_enabled;a++)
+    {
+        if(a!=ACCT_TICKS&&!atomic_load_explicit(&g_acct_available[a],memory_order_relaxed)) continue;
+        fprintf(f,"# TYPE cmr_doer_%s_total counter\n",acct_names[a]);
+        for(int i=0;i<reg->count;i++)
+        {
+            for(int k=0;k<MSGK_COUNT;k++)
+            {
+                KindCost *c=&reg->list[i]->stats.cost[k];
+                if(!counter_get(&c->handled)) continue;
+                fprintf(f,"cmr_doer_%s_total{doer=\"%s\",kind=\"%s\"} %lu\n",acct_names[a],
+                        reg->list[i]->name,rules_kind_names[k],counter_get(&c->value[a]));
+            }
+        }
+    }
+    if(!rt->worker_count) return;
+    fprintf(f,"# TYPE cmr_worker_parks_total counter\n");
+    for(int i=0;i<rt->worker_count;i++)
+        fprintf(f,"cmr_worker_parks_total{worker=\"%d\"} %lu\n",i,counter_get(&rt->workers[i].idle.parks));
+    fprintf(f,"# TYPE cmr_worker_idle_gap_seconds gauge\n");
+    for(int i=0;i<rt->worker_count;i++)
+        fprintf(f,"cmr_worker_idle_gap_seconds{worker=\"%d\"} %g\n",i,counter_get(&rt->workers[i].idle.gap_ns)/1e9);
+}
+// One exposition per connection. A client that speaks first with
+// "GET" (curl --unix-socket) gets an HTTP/1.0 header; a silent one
+// (socat, nc -U) gets plain text.
+static void metrics_serve(MetricsServer *ms,int c)
+{
+    char req[512];
+    int http=0;
+    struct pollfd pfd={.fd=c,.events=POLLIN};
+    if(poll(&pfd,1,100)>0)
+    {
+        ssize_t n=recv(c,req,sizeof(req),0);
+        http=n>=3&&memcmp(req,"GET",3)==0;
+    }
+    char *text=NULL;
+    size_t len=0;
+    FILE *f=open_memstream(&text,&len);
+    if(!f) return;
+    metrics_write(ms,f);
+    fclose(f);
+    char head[128];
+    int hn=http ? snprintf(head,sizeof(head),
+        "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n",len) : 0;
+    if(hn>0) send(c,head,(size_t)hn,MSG_NOSIGNAL);
+    for(size_t off=0;off<len;)
+    {
+        ssize_t n=send(c,text+off,len-off,MSG_NOSIGNAL);
+        if(n<=0) break;
+        off+=(size_t)n;
+    }
+    free(text);
+}
+static void *metrics_thread(void *arg)
+{
+    MetricsServer *ms=arg;
+    for(;;)
+    {
+        int c=accept(ms->fd,NULL,NULL);
+        if(c<0&&errno==EINVAL) break;   // metrics_stop shut the socket
+        if(c<0) continue;
+        metrics_serve(ms,c);
+        close(c);
+    }
+    return NULL;
+}
+static int metrics_start(MetricsServer *ms,Runtime *rt,const char *path)
+{
+    struct sockaddr_un addr={.sun_family=AF_UNIX};
+    if(strlen(path)>=sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path,path);
+    int fd=socket(AF_UNIX,SOCK_STREAM|SOCK_CLOEXEC,0);
+    if(fd<0) return -1;
+    unlink(path);
+    if(bind(fd,(struct sockaddr *)&addr,sizeof(addr))!=0||listen(fd,8)!=0)
+    {
+        close(fd);
+        return -1;
+    }
+    ms->rt=rt;
+    ms->fd=fd;
+    ms->path=path;
+    rt->metrics_enabled=1;
+    // Signals stay with the scheduler thread.
+    sigset_t all,old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK,&all,&old);
+    int rc=pthread_create(&ms->thread,NULL,metrics_thread,ms);
+    pthread_sigmask(SIG_SETMASK,&old,NULL);
+    if(rc!=0)
+    {
+        close(fd);
+        unlink(path);
+        rt->metrics_enabled=0;
+        return -1;
+    }
+    return 0;
+}
+static void metrics_stop(MetricsServer *ms)
+{
+    if(ms->fd<0) return;
+    shutdown(ms->fd,SHUT_RDWR);
+    pthread_join(ms->thread,NULL);
+    close(ms->fd);
+    unlink(ms->path);
+    ms->fd=-1;
+}
+// === JOURNAL RECOVERY ===
+// Replays every segment in order and re-enqueues the Messages that were
+// created but never handled or dropped. The recovered pending set is then
+// written to a fresh segment and the old segments are removed.
+typedef struct{
+    JournalRec rec;
+    char *payload;
+    int closed;
+}JournalPending;
+typedef struct{
+    JournalPending *items;
+    size_t count;
+    size_t cap;
+    int32_t *ids;       // open-addressing index: id → items position
+    size_t ids_cap;
+}JournalReplay;
+static size_t journal_id_hash(int32_t id,size_t cap)
+{
+    return ((uint32_t)id*2654435761u)&(cap-1);
+}
+static void journal_replay_index(JournalReplay *r,size_t pos)
+{
+    if((r->count+1)*2>r->ids_cap)
+    {
+        size_t ncap=r->ids_cap ? r->ids_cap*2 : 1024;
+        int32_t *nids=malloc(ncap*sizeof(*nids));
+        if(!nids)
+        {
+            perror("malloc");
+            exit(1);
+        }
+        for(size_t i=0;i<ncap;i++) nids[i]=-1;
+        for(size_t i=0;i<r->count;i++)
+        {
+            size_t h=journal_id_hash(r->items[i].rec.id,ncap);
+            while(nids[h]>=0) h=(h+1)&(ncap-1);
+            nids[h]=(int32_t)i;
+        }
+        free(r->ids);
+        r->ids=nids;
+        r->ids_cap=ncap;
+    }
+    size_t h=journal_id_hash(r->items[pos].rec.id,r->ids_cap);
+    while(r->ids[h]>=0) h=(h+1)&(r->ids_cap-1);
+    r->ids[h]=(int32_t)pos;
+}
+static JournalPending *journal_replay_find(JournalReplay *r,int32_t id)
+{
+    if(!r->ids_cap) return NULL;
+    size_t h=journal_id_hash(id,r->ids_cap);
+    while(r->ids[h]>=0)
+    {
+        if(r->items[r->ids[h]].rec.id==id) return &r->items[r->ids[h]];
+        h=(h+1)&(r->ids_cap-1);
+    }
+    return NULL;
+}
+static int journal_replay_segment(JournalReplay *r,const char *path)
+{
+    int fd=open(path,O_RDONLY);
+    if(fd<0) return -1;
+    struct stat st;
+    if(fstat(fd,&st)!=0)
+    {
+        close(fd);
+        return -1;
+    }
+    size_t len=(size_t)st.st_size;
+    const char *map=len ? mmap(NULL,len,PROT_READ,MAP_PRIVATE,fd,0) : MAP_FAILED;
+    close(fd);
+    if(map==MAP_FAILED||len<8||memcmp(map,JOURNAL_MAGIC,8)!=0)
+    {
+        if(map!=MAP_FAILED) munmap((void *)map,len);
+        return -1;
+    }
+    size_t off=8;
+    while(off+sizeof(JournalRec)<=len)
+    {
+        JournalRec rec;
+        memcpy(&rec,map+off,sizeof(rec));
+        if(rec.type==JREC_END||off+sizeof(rec)+rec.payload_len>len) break;
+        if(rec.type==JREC_CREATED&&journal_replay_find(r,rec.id))
+        {
+            // Re-journaled by an interrupted recovery; already known.
+        }
+        else if(rec.type==JREC_CREATED)
+        {
+            if(r->count==r->cap)
+            {
+                size_t cap=r->cap ? r->cap*2 : 1024;
+                JournalPending *items=realloc(r->items,cap*sizeof(*items));
+                if(!items)
+                {
+                    perror("realloc");
+                    exit(1);
+                }
+                r->items=items;
+                r->cap=cap;
+            }
+            JournalPending *p=&r->items[r->count];
+            p->rec=rec;
+            p->closed=0;
+            p->payload=NULL;
+            if(rec.payload_len)
+            {
+                p->payload=malloc(rec.payload_len);
+                if(!p->payload)
+                {
+                    perror("malloc");
+                    exit(1);
+                }
+                memcpy(p->payload,map+off+sizeof(rec),rec.payload_len);
+                p->payload[rec.payload_len-1]='\0';
+            }
+            journal_replay_index(r,r->count);
+            r->count++;
+        }
+        else
+        {
+            JournalPending *p=journal_replay_find(r,rec.id);
+            if(p) p->closed=1;
+        }
+        off+=sizeof(rec)+rec.payload_len;
+    }
+    munmap((void *)map,len);
+    return 0;
+}
+static int journal_segment_cmp(const void *a,const void *b)
+{
+    uint32_t x=*(const uint32_t *)a,y=*(const uint32_t *)b;
+    return x<y ? -1 : x>y;
+}
+// Opens the journal in dir, recovering any pending Messages into reg.
+// Returns the number of recovered Messages, or -1 on error.
+static long journal_open(Runtime *rt,const char *dir)
+{
+    Journal *j=&rt->journal;
+    DoerRegistry *reg=&rt->reg;
+    DIR *dp=opendir(dir);
+    if(!dp) return -1;
+    uint32_t *segs=NULL;
+    size_t nsegs=0,segs_cap=0;
+    struct dirent *de;
+    while((de=readdir(dp)))
+    {
+        unsigned no;
+        char tail;
+        if(sscanf(de->d_name,"journal-%8u.lo%c",&no,&tail)==2&&tail=='g')
+        {
+            if(nsegs==segs_cap)
+            {
+                size_t cap=segs_cap ? segs_cap*2 : 16;
+                uint32_t *grown=realloc(segs,cap*sizeof(*segs));
+                if(!grown)
+                {
+                    perror("realloc");
+                    exit(1);
+                }
+                segs=grown;
+                segs_cap=cap;
+            }
+            segs[nsegs++]=no;
+        }
+    }
+    closedir(dp);
+    qsort(segs,nsegs,sizeof(*segs),journal_segment_cmp);
+    JournalReplay r={0};
+    char path[4096];
+    for(size_t i=0;i<nsegs;i++)
+    {
+        journal_segment_path(path,sizeof(path),dir,segs[i]);
+        if(journal_replay_segment(&r,path)!=0)
+        {
+            fprintf(stderr,"journal: unreadable segment %s\n",path);
+            free(segs);
+            return -1;
+        }
+    }
+    j->dir=dir;
+    j->buf=malloc(JOURNAL_BATCH_BYTES);
+    if(!j->buf)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    uint32_t next=nsegs ? segs[nsegs-1]+1 : 1;
+    if(journal_open_segment(j,next)!=0)
+    {
+        free(segs);
+        return -1;
+    }
+    long recovered=0;
+    for(size_t i=0;i<r.count;i++)
+    {
+        JournalPending *p=&r.items[i];
+        if(p->rec.id>rt->mint_msg_id) rt->mint_msg_id=p->rec.id;
+        if(p->closed)
+        {
+            free(p->payload);
+            continue;
+        }
+        if(p->rec.slot>=reg->count)
+        {
+            fprintf(stderr,"journal: msg %d targets unknown doer slot %d\n",p->rec.id,p->rec.slot);
+            free(segs);
+            return -1;
+        }
+        Doer *d=reg->list[p->rec.slot];
+        Message m={
+            .id=p->rec.id,
+            .cap=p->rec.cap,
+            .kind=(MessageKind)p->rec.kind,
+            .to=(Target)p->rec.to,
+            .payload=p->payload
+        };
+        // Recovered Messages were created by the previous run; they
+        // re-enter this run's accounting as created and journaled again.
+        counter_add(&runtime_shard(rt)->created,1);
+        journal_record(j,JREC_CREATED,&m,d);
+        if(doer_enqueue(d,&m)!=0)
+            runtime_record_drop(&m,d,DROP_INBOX_FULL);
+        recovered++;
+    }
+    free(r.items);
+    free(r.ids);
+    if(journal_commit(j)!=0)
+    {
+        free(segs);
+        return -1;
+    }
+    for(size_t i=0;i<nsegs;i++)
+    {
+        journal_segment_path(path,sizeof(path),dir,segs[i]);
+        unlink(path);
+    }
+    free(segs);
+    return recovered;
+}
+// === SNAPSHOT ===
+// Persists runtime state (registry, pending inboxes, mint and balance
+// counters) into a flat file that startup maps back in.
+// Capabilities are not part of it: they come from the compiled rules.
+// Layout: SnapHeader | SnapDoer[doer_count] | SnapMsg[msg_count] | payloads
+// A snapshot is a resume point, not a replay: restored Messages are not
+// created again, the counters are restored with them so balance still closes.
+// Every step drains its inboxes, so Messages are only pending between a
+// step's input and its drain: SIGUSR1 snapshots there, and the one at
+// EOF holds no Messages.
+#define SNAP_MAGIC   "CMRSNAP1"
+#define SNAP_VERSION 3
+#define SNAP_NAME_LEN 80    // a 63-character pool name plus ".<member>"
+typedef struct{
+    char magic[8];
+    uint32_t version;
+    uint32_t doer_count;
+    uint64_t msg_count;
+    uint64_t payload_bytes;
+    int32_t mint_msg_id;
+    int32_t mint_cap_id;
+    uint64_t created;
+    uint64_t enqueued;
+    uint64_t handled;
+    uint64_t dropped;
+}SnapHeader;
+typedef struct{
+    char name[SNAP_NAME_LEN];
+    uint32_t msg_count;
+}SnapDoer;
+typedef struct{
+    int32_t id;
+    int32_t cap;
+    int32_t kind;
+    int32_t to;
+    uint64_t payload_off;
+    uint64_t payload_len;
+}SnapMsg;
+static volatile sig_atomic_t g_snapshot_requested = 0;
+static pid_t g_snapshot_child = 0;
+static void snapshot_on_signal(int sig)
+{
+    (void)sig;
+    g_snapshot_requested=1;
+}
+static int snapshot_write_all(int fd,const void *buf,size_t n)
+{
+    const char *p=buf;
+    while(n>0)
+    {
+        ssize_t w=write(fd,p,n);
+        if(w<0) return -1;
+        p+=w;
+        n-=(size_t)w;
+    }
+    return 0;
+}
+static int snapshot_write(Runtime *rt,const char *path)
+{
+    const DoerRegistry *reg=&rt->reg;
+    char tmp[4096];
+    snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+    int fd=open(tmp,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if(fd<0) return -1;
+    SnapHeader h;
+    memset(&h,0,sizeof(h));
+    memcpy(h.magic,SNAP_MAGIC,8);
+    h.version=SNAP_VERSION;
+    h.doer_count=(uint32_t)reg->count;
+    h.mint_msg_id=rt->mint_msg_id;
+    h.mint_cap_id=rt->mint_cap_id;
+    h.created=COUNTER_TOTAL(rt,created);
+    h.enqueued=COUNTER_TOTAL(rt,enqueued);
+    h.handled=COUNTER_TOTAL(rt,handled);
+    h.dropped=COUNTER_TOTAL(rt,dropped);
+    for(int i=0;i<reg->count;i++)
+    {
+        const Inbox *q=&reg->list[i]->inbox;
+        for(int j=0;j<inbox_depth(q);j++)
+        {
+            const char *pl=inbox_slot(q,j)->env->msg.payload;
+            h.msg_count++;
+            h.payload_bytes+=pl ? strlen(pl)+1 : 0;
+        }
+    }
+    int rc=snapshot_write_all(fd,&h,sizeof(h));
+    for(int i=0;rc==0&&i<reg->count;i++)
+    {
+        const Doer *d=reg->list[i];
+        SnapDoer sd;
+        memset(&sd,0,sizeof(sd));
+        size_t n=strlen(d->name);
+        if(n>=SNAP_NAME_LEN)
+        {
+            rc=-1;
+            break;
+        }
+        memcpy(sd.name,d->name,n);
+        sd.msg_count=(uint32_t)inbox_depth(&d->inbox);
+        rc=snapshot_write_all(fd,&sd,sizeof(sd));
+    }
+    uint64_t off=0;
+    for(int i=0;rc==0&&i<reg->count;i++)
+    {
+        const Inbox *q=&reg->list[i]->inbox;
+        for(int j=0;rc==0&&j<inbox_depth(q);j++)
+        {
+            Message m;
+            inbox_at(q,j,&m);
+            SnapMsg sm={.id=m.id,.cap=m.cap,.kind=m.kind,.to=m.to};
+            if(m.payload)
+            {
+                sm.payload_off=off;
+                sm.payload_len=strlen(m.payload);
+                off+=sm.payload_len+1;
+            }
+            else
+            {
+                sm.payload_off=UINT64_MAX;
+            }
+            rc=snapshot_write_all(fd,&sm,sizeof(sm));
+        }
+    }
+    for(int i=0;rc==0&&i<reg->count;i++)
+    {
+        const Inbox *q=&reg->list[i]->inbox;
+        for(int j=0;rc==0&&j<inbox_depth(q);j++)
+        {
+            const char *pl=inbox_slot(q,j)->env->msg.payload;
+            if(pl) rc=snapshot_write_all(fd,pl,strlen(pl)+1);
+        }
+    }
+    if(rc==0) rc=fsync(fd);
+    if(close(fd)!=0) rc=-1;
+    if(rc==0) rc=rename(tmp,path);
+    if(rc!=0) unlink(tmp);
+    return rc;
+}
+// Takes the snapshot in a forked child so the runtime keeps running:
+// the child sees a copy-on-write image of the state at fork time.
+static void snapshot_begin(Runtime *rt,const char *path)
+{
+    if(g_snapshot_child>0)
+    {
+        printf("[SNAPSHOT] previous snapshot still running, request ignored\n");
+        return;
+    }
+    fflush(stdout);
+    pid_t pid=fork();
+    if(pid<0)
+    {
+        perror("fork");
+        return;
+    }
+    if(pid==0)
+    {
+        _exit(snapshot_write(rt,path)==0 ? 0 : 1);
+    }
+    g_snapshot_child=pid;
+}
+static void snapshot_reap(int wait_for_it)
+{
+    if(g_snapshot_child<=0) return;
+    int status;
+    pid_t r=waitpid(g_snapshot_child,&status,wait_for_it ? 0 : WNOHANG);
+    if(r!=g_snapshot_child) return;
+    g_snapshot_child=0;
+    if(WIFEXITED(status)&&WEXITSTATUS(status)==0)
+        printf("[SNAPSHOT] written\n");
+    else
+        printf("[SNAPSHOT] failed\n");
+}
+static Doer *registry_find(const DoerRegistry *reg,const char *name)
+{
+    for(int i=0;i<reg->count;i++)
+    {
+        if(strcmp(reg->list[i]->name,name)==0) return reg->list[i];
+    }
+    return NULL;
+}
+// Maps a snapshot back in. Returns 1 if restored, 0 if there is none,
+// -1 if the file exists but does not match this runtime.
+// Whether the mapped file is a snapshot of this runtime, checked in
+// full before anything is enqueued: every count and offset must stay
+// inside the map, every Doer exist, every Message name a kind and
+// target of these rules and every payload end in NUL where it says.
+static int snapshot_check(const DoerRegistry *reg,const void *map,size_t len)
+{
+    const SnapHeader *h=map;
+    if(memcmp(h->magic,SNAP_MAGIC,8)!=0||h->version!=SNAP_VERSION) return 0;
+    size_t room=len-sizeof(*h);
+    if(h->doer_count>room/sizeof(SnapDoer)) return 0;
+    room-=h->doer_count*sizeof(SnapDoer);
+    if(h->msg_count>room/sizeof(SnapMsg)) return 0;
+    room-=h->msg_count*sizeof(SnapMsg);
+    if(h->payload_bytes>room) return 0;
+    const SnapDoer *sd=(const SnapDoer *)(h+1);
+    const SnapMsg *sm=(const SnapMsg *)(sd+h->doer_count);
+    const char *payloads=(const char *)(sm+h->msg_count);
+    uint64_t msgs=0;
+    for(uint32_t i=0;i<h->doer_count;i++)
+    {
+        if(memchr(sd[i].name,'\0',SNAP_NAME_LEN)==NULL) return 0;
+        Doer *d=registry_find(reg,sd[i].name);
+        if(!d||sd[i].msg_count>(uint32_t)d->inbox.high) return 0;
+        msgs+=sd[i].msg_count;
+    }
+    if(msgs!=h->msg_count) return 0;
+    for(uint64_t i=0;i<h->msg_count;i++)
+    {
+        // Content-routed Messages keep TARGET_BY_CONTENT.
+        if(sm[i].kind<0||sm[i].kind>=MSGK_COUNT||sm[i].to<0||sm[i].to>TARGET_COUNT) return 0;
+        if(sm[i].payload_off==UINT64_MAX) continue;
+        if(sm[i].payload_off>=h->payload_bytes||sm[i].payload_len>=h->payload_bytes-sm[i].payload_off
+           ||payloads[sm[i].payload_off+sm[i].payload_len]!='\0')
+            return 0;
+    }
+    return 1;
+}
+static int snapshot_restore(Runtime *rt,const char *path)
+{
+    DoerRegistry *reg=&rt->reg;
+    int fd=open(path,O_RDONLY);
+    if(fd<0) return 0;
+    struct stat st;
+    if(fstat(fd,&st)!=0||(size_t)st.st_size<sizeof(SnapHeader))
+    {
+        close(fd);
+        return -1;
+    }
+    size_t len=(size_t)st.st_size;
+    void *map=mmap(NULL,len,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(map==MAP_FAILED) return -1;
+    if(!snapshot_check(reg,map,len))
+    {
+        munmap(map,len);
+        return -1;
+    }
+    const SnapHeader *h=map;
+    const SnapDoer *sd=(const SnapDoer *)(h+1);
+    const SnapMsg *sm=(const SnapMsg *)(sd+h->doer_count);
+    const char *payloads=(const char *)(sm+h->msg_count);
+    for(uint32_t i=0;i<h->doer_count;i++)
+    {
+        Doer *d=registry_find(reg,sd[i].name);
+        for(uint32_t j=0;j<sd[i].msg_count;j++,sm++)
+        {
+            Message m={
+                .id=sm->id,
+                .cap=sm->cap,
+                .kind=(MessageKind)sm->kind,
+                .to=(Target)sm->to,
+                .payload=sm->payload_off==UINT64_MAX ? NULL : (char *)payloads+sm->payload_off
+            };
+            if(doer_enqueue(d,&m)!=0) runtime_record_drop(&m,d,DROP_INBOX_FULL);
+        }
+    }
+    rt->mint_msg_id=h->mint_msg_id;
+    rt->mint_cap_id=h->mint_cap_id;
+    // Added, not stored: re-enqueueing may already have counted a
+    // superseded Message as dropped. The header's enqueued already
+    // counts the restored Messages once.
+    CounterShard *c=&rt->counters[0];
+    counter_add(&c->created,(unsigned long)h->created);
+    counter_add(&c->enqueued,(unsigned long)(h->enqueued-h->msg_count));
+    counter_add(&c->handled,(unsigned long)h->handled);
+    counter_add(&c->dropped,(unsigned long)h->dropped);
+    rt->snapshot_map=map;
+    rt->snapshot_map_len=len;
+    return 1;
+}
+// === OFFLOAD ===
+// Handlers the rule file marks blocking (slow I/O, fsync, heavy
+// computation) do not run on a worker. The worker takes the Message
+// off the inbox as usual, copies it into a job on the Doer's offload
+// queue and moves on to its fast Doers. A bounded pool of offload
+// threads runs the jobs, each Doer's in arrival order and one at a
+// time, so a handler never runs concurrently with itself. A queue is
+// bounded by the Doer's inbox watermark (inbox_full beyond it).
+// While an offloaded handler runs, its runtime_route and
+// runtime_forward calls are captured in the job instead of executed;
+// any other runtime API that changes state aborts (offload_forbid). The driving
+// thread finishes jobs between steps, as input events like timer
+// expiries: it counts the Message handled and routes the captured
+// Messages as normal ones. Until then the Message is pending.
+#define OFFLOAD_DEFAULT_THREADS 2
+#define OFFLOAD_MAX_THREADS 16
+enum{
+    OFFLOAD_IDLE,                   // no job queued or running
+    OFFLOAD_READY,                  // on the ready list
+    OFFLOAD_RUNNING
+};
+typedef struct OffloadOut{
+    struct OffloadOut *next;
+    Message msg;
+    char payload[];
+}OffloadOut;
+typedef struct OffloadJob{
+    struct OffloadJob *next;
+    Doer *d;
+    Message msg;
+    uint64_t enq_ns;
+    OffloadOut *out;                // captured routes, in call order
+    OffloadOut **out_tail;
+    char payload[];
+}OffloadJob;
+typedef struct Offload{
+    pthread_mutex_t lock;           // guards everything below but efd
+    pthread_cond_t ready_cond;
+    Doer *ready;                    // Doers with a job queued, none running
+    Doer **ready_tail;
+    OffloadJob *done;               // finished, newest first
+    OffloadJob *retired;            // driving thread only: freed at step end
+    int stop;
+    int efd;                        // eventfd, signalled per finished job
+    int thread_count;
+    pthread_t threads[OFFLOAD_MAX_THREADS];
+}Offload;
+static void offload_capture(const Message *msg)
+{
+    OffloadJob *j=t_offload;
+    size_t len=msg->payload ? strlen(msg->payload)+1 : 0;
+    OffloadOut *o=malloc(sizeof(*o)+len);
+    if(!o)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    o->next=NULL;
+    o->msg=*msg;
+    if(len)
+    {
+        memcpy(o->payload,msg->payload,len);
+        o->msg.payload=o->payload;
+    }
+    *j->out_tail=o;
+    j->out_tail=&o->next;
+}
+// Caller holds o->lock.
+static void offload_ready(Offload *o,Doer *d)
+{
+    d->offload_state=OFFLOAD_READY;
+    d->offload_next=NULL;
+    *o->ready_tail=d;
+    o->ready_tail=&d->offload_next;
+    pthread_cond_signal(&o->ready_cond);
+}
+// Worker (or inline scheduler) side: m leaves the inbox for d's queue.
+// The payload is copied: the job outlives the step.
+static void offload_submit(Runtime *rt,Doer *d,const Message *m,uint64_t enq_ns)
+{
+    Offload *o=rt->offload;
+    size_t len=m->payload ? strlen(m->payload)+1 : 0;
+    OffloadJob *j=malloc(sizeof(*j)+len);
+    if(!j)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    j->next=NULL;
+    j->d=d;
+    j->msg=*m;
+    j->enq_ns=enq_ns;
+    j->out=NULL;
+    j->out_tail=&j->out;
+    if(len)
+    {
+        memcpy(j->payload,m->payload,len);
+        j->msg.payload=j->payload;
+    }
+    pthread_mutex_lock(&o->lock);
+    if(d->offload_queued>=d->inbox.high)
+    {
+        pthread_mutex_unlock(&o->lock);
+        free(j);
+        runtime_record_drop(m,d,DROP_INBOX_FULL);
+        return;
+    }
+    atomic_fetch_add_explicit(&rt->offload_pending,1,memory_order_relaxed);
+    *d->offload_tail=j;
+    d->offload_tail=&j->next;
+    d->offload_queued++;
+    if(d->offload_state==OFFLOAD_IDLE) offload_ready(o,d);
+    pthread_mutex_unlock(&o->lock);
+}
+static void *offload_main(void *arg)
+{
+    Runtime *rt=arg;
+    Offload *o=rt->offload;
+    pthread_mutex_lock(&o->lock);
+    for(;;)
+    {
+        while(!o->ready&&!o->stop) pthread_cond_wait(&o->ready_cond,&o->lock);
+        if(o->stop) break;
+        Doer *d=o->ready;
+        o->ready=d->offload_next;
+        if(!o->ready) o->ready_tail=&o->ready;
+        OffloadJob *j=d->offload_head;
+        d->offload_head=j->next;
+        if(!d->offload_head) d->offload_tail=&d->offload_head;
+        d->offload_queued--;
+        d->offload_state=OFFLOAD_RUNNING;
+        pthread_mutex_unlock(&o->lock);
+        uint64_t before[ACCT_COUNT];
+        t_offload=j;
+        if(rt->acct_enabled) acct_sample(before);
+        doer_dispatch(d,&j->msg);
+        if(rt->acct_enabled) acct_charge(&d->stats.cost[j->msg.kind],before);
+        t_offload=NULL;
+        pthread_mutex_lock(&o->lock);
+        j->next=o->done;
+        o->done=j;
+        if(d->offload_head) offload_ready(o,d);
+        else d->offload_state=OFFLOAD_IDLE;
+        if(write(o->efd,&(uint64_t){1},sizeof(uint64_t))<0) perror("offload");
+    }
+    pthread_mutex_unlock(&o->lock);
+    acct_thread_close();
+    return NULL;
+}
+static int offload_start(Runtime *rt,int threads)
+{
+    Offload *o=calloc(1,sizeof(*o));
+    if(!o) return -1;
+    o->efd=eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+    if(o->efd<0)
+    {
+        free(o);
+        return -1;
+    }
+    pthread_mutex_init(&o->lock,NULL);
+    pthread_cond_init(&o->ready_cond,NULL);
+    o->ready_tail=&o->ready;
+    for(int i=0;i<rt->reg.count;i++)
+        rt->reg.list[i]->offload_tail=&rt->reg.list[i]->offload_head;
+    rt->offload=o;
+    for(int i=0;i<threads;i++)
+    {
+        if(pthread_create(&o->threads[i],NULL,offload_main,rt)!=0) return -1;
+        o->thread_count++;
+    }
+    return 0;
+}
+// Resets the eventfd. A job may post to done, be collected with an
+// earlier signal, and only then write its own, so a count can be left
+// behind after offload_pending drops to 0.
+static int offload_signalled(Offload *o)
+{
+    uint64_t v;
+    return read(o->efd,&v,sizeof(v))==(ssize_t)sizeof(v);
+}
+// Driving thread, between steps: counts finished jobs handled and
+// routes what their handlers sent. Returns whether any finished.
+static int offload_collect(Runtime *rt)
+{
+    Offload *o=rt->offload;
+    pthread_mutex_lock(&o->lock);
+    OffloadJob *done=o->done;
+    o->done=NULL;
+    pthread_mutex_unlock(&o->lock);
+    OffloadJob *fifo=NULL;
+    while(done)
+    {
+        OffloadJob *j=done;
+        done=j->next;
+        j->next=fifo;
+        fifo=j;
+    }
+    int n=0;
+    while(fifo)
+    {
+        OffloadJob *j=fifo;
+        fifo=j->next;
+        counter_add(&runtime_shard(rt)->handled,1);
+        doer_stats_record(&j->d->stats,j->enq_ns);
+        journal_record(&rt->journal,JREC_HANDLED,&j->msg,j->d);
+        for(OffloadOut *out=j->out;out;out=out->next) runtime_route(rt,&out->msg);
+        atomic_fetch_sub_explicit(&rt->offload_pending,1,memory_order_relaxed);
+        j->next=o->retired;
+        o->retired=j;
+        n++;
+    }
+    return n>0;
+}
+static int offload_complete(Runtime *rt)
+{
+    if(!rt->offload||!atomic_load_explicit(&rt->offload_pending,memory_order_relaxed)) return 0;
+    if(!offload_signalled(rt->offload)) return 0;
+    return offload_collect(rt);
+}
+static void offload_free_jobs(OffloadJob *j)
+{
+    while(j)
+    {
+        OffloadJob *next=j->next;
+        for(OffloadOut *out=j->out;out;)
+        {
+            OffloadOut *o=out->next;
+            free(out);
+            out=o;
+        }
+        free(j);
+        j=next;
+    }
 }
-int main(void)
+// Step end: the captured Messages routed before the step are drained.
+static void offload_reclaim(Runtime *rt)
 {
-    // TODO(runtime):
-    // inbox_push / inbox_pop / route_message
-    // must be owned by runtime layer
-    runtime_init();
-    DoerRegistry reg;
-    registry_init(&reg);
-    registry_add(&reg,&g_doer_a);
-    registry_add(&reg,&g_doer_b);
-    Message m={.to=TARGET_BOTH,.cap=1,.payload="hi Tony."};
-    runtime_route(&m);
-    Message m1={.to=TARGET_A,.cap=1,.payload="hi 大哥."};
-    Message m2={.to=TARGET_B,.cap=2,.payload="hi 小弟."};
-    Message m3={.to=TARGET_BOTH,.cap=2,.payload="both"};
-    runtime_route(&m1);
-    runtime_route(&m2);
-    runtime_route(&m3);
-    Scheduler sched={.reg=&reg};
-/**    while(scheduler_has_work(&sched))
-    {
-        scheduler_round(&sched);
+    if(!rt->offload) return;
+    offload_free_jobs(rt->offload->retired);
+    rt->offload->retired=NULL;
+}
+// Stops the offload threads after their current job; queued and
+// unfinished jobs are discarded.
+static void offload_stop(Runtime *rt)
+{
+    Offload *o=rt->offload;
+    if(!o) return;
+    pthread_mutex_lock(&o->lock);
+    o->stop=1;
+    pthread_cond_broadcast(&o->ready_cond);
+    pthread_mutex_unlock(&o->lock);
+    for(int i=0;i<o->thread_count;i++) pthread_join(o->threads[i],NULL);
+    for(int i=0;i<rt->reg.count;i++)
+    {
+        offload_free_jobs(rt->reg.list[i]->offload_head);
+        rt->reg.list[i]->offload_head=NULL;
     }
-**/
+    offload_free_jobs(o->done);
+    offload_free_jobs(o->retired);
+    close(o->efd);
+    pthread_mutex_destroy(&o->lock);
+    pthread_cond_destroy(&o->ready_cond);
+    free(o);
+    rt->offload=NULL;
+}
+// === RUNTIME ===
+// Executes already-validated actions.
+// Does NOT perform permission checks.
+// Handles one Message of d, if any; returns whether it did.
+static int scheduler_run_doer(Doer *d)
+{
+    Runtime *rt=d->rt;
+    CounterShard *c=runtime_shard(rt);
+    Message m;
+    uint64_t enq_ns;
+    if(doer_take(d,&m,&enq_ns)!=0) return 0;
+    if(!validate_capability(caps_current(rt),m.cap,d))
+    {
+        runtime_record_drop(&m,d,DROP_CAPABILITY_DENIED);
+        return 1;
+    }
+    if(rt->offload&&((rules_blocking_kinds[d->cap_slot]>>m.kind)&1))
+    {
+        offload_submit(rt,d,&m,enq_ns);
+        return 1;
+    }
+    doer_handle(d,&m);
+    counter_add(&c->handled,1);
+    doer_stats_record(&d->stats,enq_ns);
+    journal_record(&rt->journal,JREC_HANDLED,&m,d);
+    while(t_fused.armed)
+    {
+        Doer *next=t_fused.d;
+        m=t_fused.m;
+        t_fused.armed=0;
+        m.id=mint_next_msg_id(rt);
+        counter_add(&c->created,1);
+        TRACE(rt,TRACE_EMIT,m.id,next,0);
+        journal_record(&rt->journal,JREC_CREATED,&m,next);
+        if(!validate_capability(caps_current(rt),m.cap,next))
+        {
+            runtime_record_drop(&m,next,DROP_CAPABILITY_DENIED);
+            break;
+        }
+        doer_handle(next,&m);
+        counter_add(&c->handled,1);
+        doer_stats_record(&next->stats,0);
+        journal_record(&rt->journal,JREC_HANDLED,&m,next);
+    }
+    return 1;
+}
+static void scheduler_round(Runtime *rt)
+{
+    for(int i=0;i<rt->reg.count;i++)
+    {
+        scheduler_run_doer(rt->reg.list[i]);
+    }
+}
+// === WORKERS ===
+// With -w N the Doers run on N worker threads instead of inline on the
+// main thread. Affinity groups are the unit of placement (group % N),
+// so Doers that talk to each other share a worker: their Messages go
+// through the plain inbox ring and stay in that core's cache. Only
+// deliveries between workers use the remote ring.
+// A step: the driving thread routes input while every worker is
+// parked, releases them, and waits until step_outstanding drops to zero
+// (no worker busy, no cross-worker delivery pending) and all have parked.
+// Each runtime has its own workers and step handshake.
+// IDLE condition of a worker: the step is over, or a remote delivery
+// has been claimed for one of its Doers.
+static int worker_wake_ready(void *arg)
+{
+    Worker *w=arg;
+    if(atomic_load(&w->rt->step_outstanding)==0) return 1;
+    for(int i=0;i<w->count;i++)
+    {
+        if(remote_claimed(w->doers[i]->remote)) return 1;
+    }
+    return 0;
+}
+// The step is over: nobody waits for anything any more.
+static void workers_wake_all(Runtime *rt)
+{
+    for(int i=0;i<rt->worker_count;i++) idle_wake(&rt->workers[i].idle);
+    idle_wake(&rt->step_idle);
+}
+static void worker_drain(Worker *w)
+{
+    Runtime *rt=w->rt;
+    _Atomic long *outstanding=&rt->step_outstanding;
+    for(;;)
+    {
+        caps_quiescent(rt,w->index);
+        int did=0;
+        for(int i=0;i<w->count;i++) did|=scheduler_run_doer(w->doers[i]);
+        if(did) continue;
+        // Idle: stop counting as busy until a remote delivery shows up.
+        // An idle worker holds no capability set.
+        if(atomic_fetch_sub_explicit(outstanding,1,memory_order_seq_cst)==1)
+        {
+            workers_wake_all(rt);
+            return;
+        }
+        caps_offline(rt,w->index);
+        idle_wait(&w->idle,worker_wake_ready,w);
+        caps_online(rt,w->index);
+        if(atomic_load_explicit(outstanding,memory_order_seq_cst)==0) return;
+        atomic_fetch_add_explicit(outstanding,1,memory_order_seq_cst);
+    }
+}
+static void *worker_main(void *arg)
+{
+    Worker *w=arg;
+    Runtime *rt=w->rt;
+    t_worker=w->index;
+    t_mint_block=MINT_BLOCK;
+    unsigned seen=0;
     for(;;)
     {
-        emit_stdin_event();
-        while(scheduler_has_work(&sched))
+        pthread_mutex_lock(&rt->step_lock);
+        rt->step_parked_count++;
+        pthread_cond_signal(&rt->step_parked);
+        while(rt->step_gen==seen&&!rt->step_stop) pthread_cond_wait(&rt->step_start,&rt->step_lock);
+        seen=rt->step_gen;
+        int stop=rt->step_stop;
+        pthread_mutex_unlock(&rt->step_lock);
+        if(stop) break;
+        caps_online(rt,w->index);
+        worker_drain(w);
+        caps_offline(rt,w->index);
+    }
+    acct_thread_close();
+    return NULL;
+}
+static void workers_wait_parked(Runtime *rt)
+{
+    pthread_mutex_lock(&rt->step_lock);
+    while(rt->step_parked_count<rt->worker_count) pthread_cond_wait(&rt->step_parked,&rt->step_lock);
+    pthread_mutex_unlock(&rt->step_lock);
+}
+static int workers_start(Runtime *rt,int n)
+{
+    for(int i=0;i<rt->reg.count;i++)
+    {
+        Doer *d=rt->reg.list[i];
+        Worker *w=&rt->workers[d->affinity%n];
+        Doer **doers=realloc(w->doers,(size_t)(w->count+1)*sizeof(*doers));
+        if(!doers) return -1;
+        w->doers=doers;
+        d->remote=aligned_alloc(_Alignof(RemoteInbox),sizeof(RemoteInbox));
+        if(!d->remote) return -1;
+        remote_init(d->remote);
+        w->doers[w->count++]=d;
+        d->worker=d->affinity%n;
+    }
+    rt->counter_shards=n+1;
+    idle_init(&rt->step_idle);
+    // Signals stay with the main thread.
+    sigset_t all,old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK,&all,&old);
+    for(int i=0;i<n;i++)
+    {
+        rt->workers[i].rt=rt;
+        rt->workers[i].index=i;
+        idle_init(&rt->workers[i].idle);
+        if(pthread_create(&rt->workers[i].thread,NULL,worker_main,&rt->workers[i])!=0)
         {
-            scheduler_round(&sched);
+            pthread_sigmask(SIG_SETMASK,&old,NULL);
+            return -1;
         }
-        runtime_print_message_balance(&reg);
+        rt->worker_count=i+1;
+    }
+    pthread_sigmask(SIG_SETMASK,&old,NULL);
+    workers_wait_parked(rt);
+    return 0;
+}
+// IDLE condition of the driving thread. Retired capability sets are
+// reclaimed while it waits.
+static int workers_step_done(void *arg)
+{
+    Runtime *rt=arg;
+    caps_reclaim(rt);
+    return atomic_load(&rt->step_outstanding)==0;
+}
+static void workers_step(Runtime *rt)
+{
+    pthread_mutex_lock(&rt->step_lock);
+    rt->step_parked_count=0;
+    atomic_store(&rt->step_outstanding,rt->worker_count);
+    rt->step_gen++;
+    pthread_cond_broadcast(&rt->step_start);
+    pthread_mutex_unlock(&rt->step_lock);
+    idle_wait(&rt->step_idle,workers_step_done,rt);
+    workers_wait_parked(rt);
+}
+// Between steps only: every worker is parked.
+static void workers_stop(Runtime *rt)
+{
+    pthread_mutex_lock(&rt->step_lock);
+    rt->step_stop=1;
+    pthread_cond_broadcast(&rt->step_start);
+    pthread_mutex_unlock(&rt->step_lock);
+    for(int i=0;i<rt->worker_count;i++)
+    {
+        pthread_join(rt->workers[i].thread,NULL);
+        free(rt->workers[i].doers);
+    }
+    rt->worker_count=0;
+}
+// Runs every Message reachable from the current inboxes to an outcome.
+static void scheduler_drain(Runtime *rt)
+{
+    if(rt->worker_count)
+    {
+        workers_step(rt);
+        return;
+    }
+    while(scheduler_has_work(rt))
+    {
+        scheduler_round(rt);
     }
-    /**char line[1024];
-    while(printf(">>>"),fflush(stdout),fgets(line,sizeof(line),stdin))
+}
+// === RUNTIME LIFETIME ===
+// A fresh runtime: rule Doers registered in slot order, empty pools,
+// topics and timer wheel, no workers. Pool members, workers, metrics,
+// journal and snapshot are added by the caller.
+static Runtime *runtime_create(void)
+{
+    Runtime *rt=aligned_alloc(_Alignof(Runtime),sizeof(*rt));
+    TimerWheel *timer=malloc(sizeof(*timer));
+    if(!rt||!timer)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    memset(rt,0,sizeof(*rt));
+    rt->counter_shards=1;
+    rt->next_affinity=RULES_AFFINITY_COUNT;
+    journal_init(&rt->journal);
+    pthread_mutex_init(&rt->topic_writer,NULL);
+    pthread_mutex_init(&rt->caps_writer,NULL);
+    pthread_mutex_init(&rt->step_lock,NULL);
+    pthread_cond_init(&rt->step_start,NULL);
+    pthread_cond_init(&rt->step_parked,NULL);
+    CapabilitySet *caps=malloc(sizeof(*caps));
+    if(!caps)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    caps->next_retired=NULL;
+    memcpy(caps->doers,rules_cap_doers,sizeof(caps->doers));
+    atomic_init(&rt->caps,caps);
+    for(int i=0;i<MAX_WORKERS;i++) atomic_init(&rt->caps_seen[i].epoch,CAPS_OFFLINE);
+    rt->timer=timer;
+    timer_init(timer,rt);
+#define RULES_DOER_INIT(slot_,name_) \
+    rt->doers[slot_].name=name_;
+    RULES_DOERS(RULES_DOER_INIT)
+#undef RULES_DOER_INIT
+#define RULES_POOL_INIT(pool_,name_,cap_slot_) \
+    rt->pools[pool_].name=name_; \
+    rt->pools[pool_].cap_slot=cap_slot_; \
+    rt->pools[pool_].rng=0x9e3779b9u+pool_;
+    RULES_POOLS(RULES_POOL_INIT)
+#undef RULES_POOL_INIT
+    registry_init(&rt->reg);
+    for(int i=0;i<RULES_DOER_COUNT;i++)
+    {
+        Doer *d=&rt->doers[i];
+        d->rt=rt;
+        d->cap_slot=i;
+        d->affinity=rules_doer_affinity[i];
+        inbox_init(&d->inbox,rules_inbox_high[i],rules_inbox_low[i]);
+        registry_add(&rt->reg,d);
+    }
+    return rt;
+}
+// Stops the workers and frees everything the runtime owns, including
+// Messages still pending. Call between steps.
+static void runtime_destroy(Runtime *rt)
+{
+    workers_stop(rt);
+    offload_stop(rt);
+    trace_close(rt);
+    node_free(rt);
+    for(int i=0;i<rt->reg.count;i++)
     {
-        size_t len=strlen(line);
-        if(len>0&&line[len-1]=='\n')
+        Doer *d=rt->reg.list[i];
+        inbox_free(&d->inbox);
+        InboxSlot s;
+        while(d->remote&&remote_pop(d->remote,&s)==0) envelope_release(s.env);
+        if(d->remote) pthread_mutex_destroy(&d->remote->spill_lock);
+        free(d->remote);
+        if(d<rt->doers||d>=rt->doers+RULES_DOER_COUNT)
         {
-            line[len-1]='\0';
+            free((char *)d->name);
+            free(d);
         }
-        Command cmd=parse_command(line);
-        Message msg={0};
-        C2MResult r=command_to_message(&cmd,&msg);
-        switch(r)
+    }
+    for(int i=0;i<RULES_POOL_COUNT;i++) free(rt->pools[i].members);
+    topic_reclaim(rt);
+    for(int t=0;t<TOPIC_COUNT;t++) free(atomic_load(&rt->topic_subs[t]));
+    caps_reclaim(rt);
+    free(atomic_load(&rt->caps));
+    timer_destroy(rt->timer);
+    free(rt->timer);
+    journal_close(&rt->journal);
+    if(rt->snapshot_map) munmap(rt->snapshot_map,rt->snapshot_map_len);
+    pthread_mutex_destroy(&rt->topic_writer);
+    pthread_mutex_destroy(&rt->caps_writer);
+    pthread_mutex_destroy(&rt->step_lock);
+    pthread_cond_destroy(&rt->step_start);
+    pthread_cond_destroy(&rt->step_parked);
+    free(rt);
+}
+// External world → CMR boundary
+// Raw events must be converted into Messages before entering runtime.
+// Input is read with read(2) into one buffer so the same poll can wait
+// on stdin and the timer wheel; a due timer is an event of its own.
+// Returns 0 once stdin is closed (and no timer is pending) or an exit
+// command arrives; either way it first waits for the node links and
+// offloaded handlers to finish.
+// Lines stay in the buffer until the next refill: routed Messages point
+// into it until the scheduler has drained them.
+#define STDIN_BUF 4096
+typedef struct{
+    char buf[STDIN_BUF];
+    size_t off;
+    size_t len;
+    int eof;
+    int exit;           // exit command seen: pending timers are dropped
+}StdinReader;
+static StdinReader g_stdin;
+// Next complete line (or the tail at EOF / of a full buffer), NUL
+// terminated in place; NULL when more input is needed.
+static char *stdin_take_line(StdinReader *r,size_t *n)
+{
+    char *start=r->buf+r->off;
+    size_t avail=r->len-r->off;
+    char *nl=memchr(start,'\n',avail);
+    if(nl)
+    {
+        *n=(size_t)(nl-start);
+    }
+    else if(avail&&(r->eof||r->len==sizeof(r->buf)-1))
+    {
+        *n=avail;
+        nl=start+avail;
+    }
+    else
+    {
+        return NULL;
+    }
+    *nl='\0';
+    r->off+=*n+(r->off+*n<r->len);
+    return start;
+}
+static void stdin_fill(StdinReader *r)
+{
+    if(r->off)
+    {
+        memmove(r->buf,r->buf+r->off,r->len-r->off);
+        r->len-=r->off;
+        r->off=0;
+    }
+    ssize_t got=read(STDIN_FILENO,r->buf+r->len,sizeof(r->buf)-1-r->len);
+    if(got>0) r->len+=(size_t)got;
+    else if(got==0) r->eof=1;
+}
+// "grant CAP NAME" / "revoke CAP NAME": NAME is a rule Doer or pool.
+static void runtime_caps_command(Runtime *rt,const char *args,int grant)
+{
+    const char *what=grant ? "grant" : "revoke";
+    char name[64];
+    int cap,end=0;
+    int slot=-1;
+    if(sscanf(args,"%d %63s %n",&cap,name,&end)==2&&args[end]=='\0')
+    {
+        for(int i=0;i<RULES_DOER_COUNT;i++)
+            if(strcmp(rt->doers[i].name,name)==0) slot=i;
+        for(int i=0;i<RULES_POOL_COUNT;i++)
+            if(strcmp(rt->pools[i].name,name)==0) slot=rt->pools[i].cap_slot;
+    }
+    int rc=slot<0 ? -1 : grant ? runtime_grant(rt,cap,slot) : runtime_revoke(rt,cap,slot);
+    if(rc!=0)
+    {
+        printf("[CAPS] rejected %s \"%s\"\n",what,args);
+        return;
+    }
+    printf("[CAPS] %s cap=%d doer=%s epoch=%llu\n",what,cap,name,
+           (unsigned long long)atomic_load(&rt->caps_epoch));
+}
+// "subscribe TOPIC NAME" / "unsubscribe TOPIC NAME": NAME is any
+// registered Doer, pool members included. "publish TOPIC TEXT" sends
+// an app Message with the topic's capability to its subscribers.
+static void runtime_topic_command(Runtime *rt,char *args,C2MResult op)
+{
+    const char *what=op==C2M_CTRL_SUBSCRIBE ? "subscribe" : op==C2M_CTRL_UNSUBSCRIBE ? "unsubscribe" : "publish";
+    size_t n=strcspn(args," \t");
+    Topic t=TOPIC_COUNT;
+    for(int i=0;i<TOPIC_COUNT;i++)
+        if(strlen(rules_topic_names[i])==n&&strncmp(rules_topic_names[i],args,n)==0) t=(Topic)i;
+    char *rest=args+n;
+    while(*rest==' '||*rest=='\t') rest++;
+    if(t==TOPIC_COUNT||*rest=='\0')
+    {
+        printf("[TOPIC] rejected %s \"%s\"\n",what,args);
+        return;
+    }
+    if(op==C2M_CTRL_PUBLISH)
+    {
+        Message m={.kind=MSGK_APP,.cap=rules_topic_cap[t],.payload=rest};
+        runtime_publish(rt,t,&m);
+        return;
+    }
+    Doer *d=registry_find(&rt->reg,rest);
+    int rc=!d ? -1 : op==C2M_CTRL_SUBSCRIBE ? runtime_subscribe(rt,t,d) : runtime_unsubscribe(rt,t,d);
+    if(rc!=0)
+    {
+        printf("[TOPIC] rejected %s \"%s\"\n",what,args);
+        return;
+    }
+    printf("[TOPIC] %s topic=%s doer=%s\n",what,rules_topic_names[t],d->name);
+}
+static int emit_stdin_event(Runtime *rt)
+{
+    TimerWheel *timer=rt->timer;
+    for(;;)
+    {
+        if(offload_complete(rt)) return 1;
+        size_t n;
+        char *line=stdin_take_line(&g_stdin,&n);
+        if(line)
         {
-              case C2M_OK:
-                  runtime_route(&msg);
-                  break;
-              case C2M_CTRL_EXIT:
-                  return 0;
-              case C2M_NOOP:
-                  break;
+            Message msg={0};
+            C2MResult r=boundary_decode(line,n,&msg);
+            switch(r)
+            {
+                case C2M_OK:
+                    runtime_route(rt,&msg);
+                    return 1;
+                case C2M_CTRL_EXIT:
+                    if(!rt->node&&!rt->offload) return 0;
+                    g_stdin.eof=1;      // stop reading; links and offloads still finish
+                    g_stdin.exit=1;
+                    return 1;
+                case C2M_CTRL_GRANT:
+                    runtime_caps_command(rt,msg.payload,1);
+                    return 1;
+                case C2M_CTRL_REVOKE:
+                    runtime_caps_command(rt,msg.payload,0);
+                    return 1;
+                case C2M_CTRL_SUBSCRIBE:
+                case C2M_CTRL_UNSUBSCRIBE:
+                case C2M_CTRL_PUBLISH:
+                    runtime_topic_command(rt,msg.payload,r);
+                    return 1;
+                case C2M_REJECT:
+                    printf("[REJECT] input=\"%s\" (malformed command)\n",line);
+                    return 1;
+                case C2M_NOOP:
+                default:
+                    return 1;
+            }
         }
-    }**/
-
+        if(g_stdin.eof&&(g_stdin.exit||!timer->pending)&&node_finished(rt)
+           &&!atomic_load_explicit(&rt->offload_pending,memory_order_relaxed))
+            return 0;
+        timer_arm(timer);
+        fflush(stdout);
+        struct pollfd pfd[3+1+NODE_MAX_CONNS]={
+            {.fd=g_stdin.exit ? -1 : timer->fd,.events=POLLIN},
+            {.fd=g_stdin.eof ? -1 : STDIN_FILENO,.events=POLLIN},
+            {.fd=rt->offload ? rt->offload->efd : -1,.events=POLLIN},
+        };
+        int count=3+node_poll_fill(rt,pfd+3,1+NODE_MAX_CONNS);
+        if(poll(pfd,(nfds_t)count,-1)<0) return 1;  // a signal: let the step run
+        if(pfd[0].revents&&timer_expire(timer)) return 1;
+        if(pfd[1].revents) stdin_fill(&g_stdin);
+        // Reset the eventfd whatever offload_pending says, or a stale
+        // count keeps poll returning at once.
+        if(pfd[2].revents&&offload_signalled(rt->offload)&&offload_collect(rt)) return 1;
+        if(count>3&&node_poll_handle(rt,pfd+3,count-3)) return 1;
+    }
+}
+// Housekeeping between input steps: reclaim retired topic arrays,
+// capability sets and timer nodes, make the step durable, flush the
+// drop log and trace buffers, send what the step forwarded.
+static int runtime_step_end(Runtime *rt)
+{
+    topic_reclaim(rt);
+    caps_reclaim(rt);
+    timer_reclaim(rt->timer);
+    if(journal_commit(&rt->journal)!=0) return -1;
+    drop_log_summary(&rt->drop_log);
+    trace_step_end(rt);
+    node_flush(rt);
+    offload_reclaim(rt);
+    return 0;
+}
+// Waits until no offloaded handler is outstanding, finishing the jobs
+// and running the steps their captured Messages start.
+static int offload_settle(Runtime *rt)
+{
+    while(atomic_load(&rt->offload_pending))
+    {
+        struct pollfd p={.fd=rt->offload->efd,.events=POLLIN};
+        if(poll(&p,1,-1)<0&&errno!=EINTR) return -1;
+        if(!offload_complete(rt)) continue;
+        scheduler_drain(rt);
+        if(runtime_step_end(rt)!=0) return -1;
+    }
+    return 0;
+}
+// === LOAD GENERATOR ===
+// -l SPEC drives runtime_route from synthetic producers instead of
+// stdin. SPEC is a comma-separated list of key=value:
+//   mode=open|closed   open: fixed rate, sends never wait for the
+//                      runtime; closed: each producer sends one
+//                      Message, waits for the step, sends the next
+//   rate=N             open loop: Messages per second, all producers
+//   producers=N        open loop: the rate is split into N evenly
+//                      phased schedules; closed loop: Messages per step
+//   duration=SECONDS   run length (default 1)
+//   count=N            stop after N Messages (0: no limit)
+//   size=fixed:N | uniform:MIN:MAX | exp:MEAN   payload bytes
+//   fanout=F           share of Messages sent to multicast targets
+//   invalid=F          share sent with a capability no Doer holds
+//   to=VERB[:VERB...]  restrict to these targets (default: all)
+//   seed=N
+// Producers are schedules multiplexed on the driving thread: the
+// runtime takes input between steps only. Open-loop latency runs from
+// the time a Message was due to the end of the step that brought it to
+// an outcome, so a stalled runtime is charged for every Message it kept
+// waiting (no coordinated omission). Closed-loop latency runs from the
+// actual send. The run fails if the final balance is not zero.
+#define LOAD_MAX_PAYLOAD 65536
+#define LOAD_MAX_PRODUCERS 1024
+#define LOAD_SUB_BITS 4
+typedef enum{
+    LOAD_SIZE_FIXED,
+    LOAD_SIZE_UNIFORM,
+    LOAD_SIZE_EXP
+}LoadSizeDist;
+typedef struct{
+    int closed;
+    double rate;
+    int producers;
+    double duration;
+    unsigned long count;
+    LoadSizeDist size_dist;
+    unsigned long size_a;
+    unsigned long size_b;
+    double fanout;
+    double invalid;
+    uint64_t seed;
+    uint8_t only[TARGET_COUNT];     // targets picked with to=
+    int only_count;
+}LoadSpec;
+// Log-linear histogram: 16 sub-buckets per power of two (about 6%
+// resolution); a percentile reports its bucket's upper bound.
+typedef struct{
+    unsigned long count[64<<LOAD_SUB_BITS];
+    unsigned long total;
+    uint64_t max;
+}LoadHist;
+static int load_hist_index(uint64_t v)
+{
+    if(v<(1u<<LOAD_SUB_BITS)) return (int)v;
+    int shift=63-__builtin_clzll(v)-LOAD_SUB_BITS;
+    return ((shift+1)<<LOAD_SUB_BITS)|(int)((v>>shift)&((1u<<LOAD_SUB_BITS)-1));
+}
+static uint64_t load_hist_upper(int i)
+{
+    int g=i>>LOAD_SUB_BITS;
+    uint64_t sub=(uint64_t)(i&((1<<LOAD_SUB_BITS)-1));
+    if(g==0) return sub;
+    return (((1u<<LOAD_SUB_BITS)+sub+1)<<(g-1))-1;
+}
+static void load_hist_record(LoadHist *h,uint64_t ns)
+{
+    h->count[load_hist_index(ns)]++;
+    h->total++;
+    if(ns>h->max) h->max=ns;
+}
+static uint64_t load_hist_percentile(const LoadHist *h,double p)
+{
+    unsigned long want=(unsigned long)(p*(double)h->total+0.999999);
+    unsigned long seen=0;
+    if(want==0) want=1;
+    for(int i=0;i<(64<<LOAD_SUB_BITS);i++)
+    {
+        seen+=h->count[i];
+        if(seen>=want) return load_hist_upper(i)<h->max ? load_hist_upper(i) : h->max;
+    }
+    return h->max;
+}
+static uint64_t load_rand(uint64_t *s)
+{
+    *s^=*s<<13;
+    *s^=*s>>7;
+    *s^=*s<<17;
+    return *s;
+}
+static double load_unit(uint64_t *s)
+{
+    return (double)(load_rand(s)>>11)*(1.0/9007199254740992.0);
+}
+// ln(x) for x in (0,1], without libm: scale into [0.5,1) by powers of
+// two, then the atanh series, which converges fast for |s|<=1/3.
+static double load_ln(double x)
+{
+    int e=0;
+    while(x<0.5)
+    {
+        x*=2;
+        e--;
+    }
+    double s=(x-1)/(x+1),s2=s*s;
+    double r=s*(1+s2*(1.0/3+s2*(1.0/5+s2*(1.0/7+s2*(1.0/9+s2/11)))));
+    return 2*r+e*0.69314718055994530942;
+}
+static int load_parse_spec(LoadSpec *ls,const char *text)
+{
+    *ls=(LoadSpec){.rate=10000,.producers=1,.duration=1,.size_a=16,.seed=1};
+    char *copy=strdup(text);
+    char *save=NULL;
+    int rc=0;
+    for(char *kv=strtok_r(copy,",",&save);kv&&rc==0;kv=strtok_r(NULL,",",&save))
+    {
+        char *v=strchr(kv,'=');
+        if(!v)
+        {
+            rc=-1;
+            break;
+        }
+        *v++='\0';
+        char *end=v;
+        if(strcmp(kv,"mode")==0)
+        {
+            if(strcmp(v,"open")==0) ls->closed=0;
+            else if(strcmp(v,"closed")==0) ls->closed=1;
+            else rc=-1;
+            end=v+strlen(v);
+        }
+        else if(strcmp(kv,"rate")==0) ls->rate=strtod(v,&end);
+        else if(strcmp(kv,"producers")==0) ls->producers=(int)strtol(v,&end,10);
+        else if(strcmp(kv,"duration")==0) ls->duration=strtod(v,&end);
+        else if(strcmp(kv,"count")==0) ls->count=strtoul(v,&end,10);
+        else if(strcmp(kv,"fanout")==0) ls->fanout=strtod(v,&end);
+        else if(strcmp(kv,"invalid")==0) ls->invalid=strtod(v,&end);
+        else if(strcmp(kv,"seed")==0) ls->seed=strtoull(v,&end,10);
+        else if(strcmp(kv,"size")==0)
+        {
+            if(sscanf(v,"fixed:%lu",&ls->size_a)==1)
+                ls->size_dist=LOAD_SIZE_FIXED;
+            else if(sscanf(v,"uniform:%lu:%lu",&ls->size_a,&ls->size_b)==2&&ls->size_a<=ls->size_b)
+                ls->size_dist=LOAD_SIZE_UNIFORM;
+            else if(sscanf(v,"exp:%lu",&ls->size_a)==1)
+                ls->size_dist=LOAD_SIZE_EXP;
+            else
+                rc=-1;
+            end=v+strlen(v);
+        }
+        else if(strcmp(kv,"to")==0)
+        {
+            for(char *t=v;*t;)
+            {
+                size_t n=strcspn(t,":");
+                const RulesVerb *rv=boundary_lookup(t,n,n);
+                if(!rv||rv->target<0)
+                {
+                    rc=-1;
+                    break;
+                }
+                if(!ls->only[rv->target]) ls->only_count++;
+                ls->only[rv->target]=1;
+                t+=n+(t[n]==':');
+            }
+            end=v+strlen(v);
+        }
+        else rc=-1;
+        if(*end!='\0') rc=-1;
+    }
+    free(copy);
+    if(ls->rate<=0||ls->duration<=0||ls->fanout<0||ls->fanout>1||ls->invalid<0||ls->invalid>1
+       ||ls->producers<1||ls->producers>LOAD_MAX_PRODUCERS||!ls->seed
+       ||ls->size_a>LOAD_MAX_PAYLOAD||ls->size_b>LOAD_MAX_PAYLOAD)
+        rc=-1;
+    return rc;
+}
+static int load_slot_accepts(const CapabilitySet *cs,int slot,int cap,int kind)
+{
+    return (int)((cs->doers[cap][slot>>6]>>(slot&63))&1)&&((rules_kind_mask[slot]>>kind)&1);
+}
+// The capability and kind that most of a target's Doers accept, so a
+// "valid" Message is handled wherever the rules allow it (cap 0: none).
+static void load_target_pick(const CapabilitySet *cs,Target t,int *cap_out,MessageKind *kind_out)
+{
+    int best_n=0;
+    *cap_out=0;
+    *kind_out=RULES_STDIN_KIND;
+    for(int cap=1;cap<RULES_CAP_LIMIT;cap++)
+    {
+        for(int kind=0;kind<MSGK_COUNT;kind++)
+        {
+            int n=0;
+            if(rules_route_pool[t]>=0)
+                n=load_slot_accepts(cs,RULES_DOER_COUNT+rules_route_pool[t],cap,kind);
+            for(uint32_t i=rules_route_offset[t];i<rules_route_offset[t+1];i++)
+                n+=load_slot_accepts(cs,(int)rules_route_doers[i],cap,kind);
+            if(n>best_n)
+            {
+                best_n=n;
+                *cap_out=cap;
+                *kind_out=(MessageKind)kind;
+            }
+        }
+    }
+}
+typedef struct{
+    const LoadSpec *spec;
+    uint64_t rng;
+    Target single[TARGET_COUNT];
+    int single_count;
+    Target multi[TARGET_COUNT];
+    int multi_count;
+    int cap[TARGET_COUNT];
+    MessageKind kind[TARGET_COUNT];
+    const char *payload;            // LOAD_MAX_PAYLOAD 'x' bytes, NUL ended
+    unsigned long sent;
+    unsigned long invalid;
+}LoadGen;
+static void load_gen_init(LoadGen *g,Runtime *rt,const LoadSpec *ls,const char *payload)
+{
+    memset(g,0,sizeof(*g));
+    g->spec=ls;
+    g->rng=ls->seed;
+    g->payload=payload;
+    for(int t=0;t<TARGET_COUNT;t++)
+    {
+        if(ls->only_count&&!ls->only[t]) continue;
+        load_target_pick(caps_current(rt),(Target)t,&g->cap[t],&g->kind[t]);
+        if(rules_route_pool[t]<0&&rules_route_offset[t+1]-rules_route_offset[t]>1)
+            g->multi[g->multi_count++]=(Target)t;
+        else
+            g->single[g->single_count++]=(Target)t;
+    }
+}
+static unsigned long load_payload_len(LoadGen *g)
+{
+    const LoadSpec *ls=g->spec;
+    unsigned long n=ls->size_a;
+    if(ls->size_dist==LOAD_SIZE_UNIFORM)
+        n=ls->size_a+(unsigned long)(load_rand(&g->rng)%(ls->size_b-ls->size_a+1));
+    else if(ls->size_dist==LOAD_SIZE_EXP)
+        n=(unsigned long)(-load_ln(1.0-load_unit(&g->rng))*(double)ls->size_a);
+    return n<LOAD_MAX_PAYLOAD ? n : LOAD_MAX_PAYLOAD;
+}
+static void load_send(Runtime *rt,LoadGen *g)
+{
+    int multi=g->multi_count&&(!g->single_count||load_unit(&g->rng)<g->spec->fanout);
+    Target t=multi ? g->multi[load_rand(&g->rng)%(uint64_t)g->multi_count]
+                   : g->single[load_rand(&g->rng)%(uint64_t)g->single_count];
+    Message m={.kind=g->kind[t],.to=t,.cap=g->cap[t]};
+    if(load_unit(&g->rng)<g->spec->invalid)
+    {
+        m.cap=0;
+        g->invalid++;
+    }
+    // A suffix of the shared buffer is a payload of any length.
+    m.payload=(char *)g->payload+LOAD_MAX_PAYLOAD-load_payload_len(g);
+    g->sent++;
+    runtime_route(rt,&m);
+}
+// Runs the load; returns the final message balance.
+static long load_run(Runtime *rt,const LoadSpec *ls)
+{
+    char *payload=malloc(LOAD_MAX_PAYLOAD+1);
+    uint64_t *due=malloc(sizeof(*due)*(size_t)ls->producers);
+    uint64_t *batch=NULL;
+    size_t batch_cap=0;
+    LoadHist *hist=calloc(1,sizeof(*hist));
+    if(!payload||!due||!hist)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    memset(payload,'x',LOAD_MAX_PAYLOAD);
+    payload[LOAD_MAX_PAYLOAD]='\0';
+    LoadGen g;
+    load_gen_init(&g,rt,ls,payload);
+    unsigned long handled0=COUNTER_TOTAL(rt,handled);
+    uint64_t start=monotonic_ns();
+    uint64_t stop=start+(uint64_t)(ls->duration*1e9);
+    double period=1e9*(double)ls->producers/ls->rate;
+    for(int p=0;p<ls->producers;p++)
+        due[p]=start+(uint64_t)(period*p/ls->producers);
+    unsigned long sends=0;
+    while((!ls->count||g.sent<ls->count)&&(g.single_count||g.multi_count))
+    {
+        uint64_t now=monotonic_ns();
+        if(now>=stop) break;
+        size_t n=0;
+        for(int p=0;p<ls->producers&&(!ls->count||g.sent<ls->count);p++)
+        {
+            // Closed loop: one Message per producer, sent now.
+            // Open loop: everything each schedule owes up to now.
+            while(ls->closed ? n<(size_t)p+1 : due[p]<=now&&due[p]<stop)
+            {
+                if(n==batch_cap)
+                {
+                    batch_cap=batch_cap ? batch_cap*2 : 1024;
+                    batch=realloc(batch,batch_cap*sizeof(*batch));
+                    if(!batch)
+                    {
+                        perror("malloc");
+                        exit(1);
+                    }
+                }
+                batch[n++]=ls->closed ? now : due[p];
+                load_send(rt,&g);
+                due[p]+=(uint64_t)period;
+                if(ls->count&&g.sent>=ls->count) break;
+            }
+        }
+        if(n==0)
+        {
+            uint64_t next=stop;
+            for(int p=0;p<ls->producers;p++)
+                if(due[p]<next) next=due[p];
+            struct timespec ts={.tv_sec=(time_t)(next/1000000000u),.tv_nsec=(long)(next%1000000000u)};
+            clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,NULL);
+            continue;
+        }
+        offload_complete(rt);
+        scheduler_drain(rt);
+        uint64_t done=monotonic_ns();
+        for(size_t i=0;i<n;i++) load_hist_record(hist,done-batch[i]);
+        sends+=n;
+        if(runtime_step_end(rt)!=0)
+        {
+            perror("journal");
+            exit(1);
+        }
+    }
+    scheduler_drain(rt);
+    if(runtime_step_end(rt)!=0||offload_settle(rt)!=0)
+    {
+        perror("journal");
+        exit(1);
+    }
+    double secs=(double)(monotonic_ns()-start)/1e9;
+    unsigned long handled=COUNTER_TOTAL(rt,handled)-handled0;
+    printf("[LOAD] mode=%s producers=%d sent=%lu invalid=%lu seconds=%.3f offered_per_s=%.0f handled=%lu handled_per_s=%.0f\n",
+           ls->closed ? "closed" : "open",ls->producers,g.sent,g.invalid,secs,
+           (double)sends/secs,handled,(double)handled/secs);
+    printf("[LOAD_LATENCY] %s p50_us=%.1f p90_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f\n",
+           ls->closed ? "from_send" : "from_due",
+           load_hist_percentile(hist,0.50)/1e3,load_hist_percentile(hist,0.90)/1e3,
+           load_hist_percentile(hist,0.99)/1e3,load_hist_percentile(hist,0.999)/1e3,
+           (double)hist->max/1e3);
+    long balance=runtime_print_message_balance(rt);
+    free(batch);
+    free(hist);
+    free(due);
+    free(payload);
+    return balance;
+}
+// A positive count option (-m, -b, -p); 0 and signs are rejected, since
+// an unset budget is what means unlimited.
+static int parse_budget(const char *text,unsigned long *out)
+{
+    char *end;
+    errno=0;
+    if(!isdigit((unsigned char)text[0])) return -1;
+    unsigned long v=strtoul(text,&end,10);
+    if(errno||*end!='\0'||v==0) return -1;
+    *out=v;
+    return 0;
+}
+static void usage(const char *prog)
+{
+    fprintf(stderr,"usage: %s [-s snapshot-file | -j journal-dir] [-m max-inflight] [-b max-inflight-bytes] [-p max-payload-bytes] [-M metrics-socket] [-w workers] [-l load-spec] [-T trace-file] [-L [host:]port] [-R doer=host:port]... [-a] [-O offload-threads]\n",prog);
+}
+int main(int argc,char **argv)
+{
+    const char *snapshot_path=NULL;
+    const char *journal_dir=NULL;
+    const char *metrics_path=NULL;
+    int worker_count=0;
+    const char *load_spec=NULL;
+    const char *trace_path=NULL;
+    const char *listen_spec=NULL;
+    int acct=0;
+    int offload_threads=RULES_HAS_BLOCKING ? OFFLOAD_DEFAULT_THREADS : 0;
+    const char *proxy_specs[RULES_DOER_COUNT];
+    int proxy_count=0;
+    LoadSpec load;
+    Admission admission={0};
+    int opt;
+    while((opt=getopt(argc,argv,"s:j:m:b:p:M:w:l:T:L:R:aO:"))!=-1)
+    {
+        switch(opt)
+        {
+            case 's':
+                snapshot_path=optarg;
+                break;
+            case 'j':
+                journal_dir=optarg;
+                break;
+            case 'm':
+                if(parse_budget(optarg,&admission.max_msgs)!=0)
+                {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'b':
+                if(parse_budget(optarg,&admission.max_bytes)!=0)
+                {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'p':
+                if(parse_budget(optarg,&admission.max_payload)!=0)
+                {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'M':
+                metrics_path=optarg;
+                break;
+            case 'w':
+                worker_count=atoi(optarg);
+                if(worker_count<0||worker_count>MAX_WORKERS)
+                {
+                    fprintf(stderr,"-w takes 0..%d workers\n",MAX_WORKERS);
+                    return 2;
+                }
+                break;
+            case 'T':
+                trace_path=optarg;
+                break;
+            case 'L':
+                listen_spec=optarg;
+                break;
+            case 'a':
+                acct=1;
+                break;
+            case 'O':
+                offload_threads=atoi(optarg);
+                if(offload_threads<0||offload_threads>OFFLOAD_MAX_THREADS)
+                {
+                    fprintf(stderr,"-O takes 0..%d threads\n",OFFLOAD_MAX_THREADS);
+                    return 2;
+                }
+                break;
+            case 'R':
+                if(proxy_count==RULES_DOER_COUNT)
+                {
+                    fprintf(stderr,"-R given more than once per Doer\n");
+                    return 2;
+                }
+                proxy_specs[proxy_count++]=optarg;
+                break;
+            case 'l':
+                load_spec=optarg;
+                if(load_parse_spec(&load,load_spec)!=0)
+                {
+                    fprintf(stderr,"bad load spec: %s\n",load_spec);
+                    return 2;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    // A snapshot restores counters that a journal would replay again;
+    // the two recovery sources are alternatives, not layers.
+    if(snapshot_path&&journal_dir)
+    {
+        fprintf(stderr,"-s and -j are mutually exclusive\n");
+        return 2;
+    }
+    // A node's counters only balance together with its peers', which a
+    // local snapshot, journal or load run cannot account for.
+    if((listen_spec||proxy_count)&&(snapshot_path||journal_dir||load_spec))
+    {
+        fprintf(stderr,"-L and -R cannot be combined with -s, -j or -l\n");
+        return 2;
+    }
+    Runtime *rt=runtime_create();
+    rt->admission.max_msgs=admission.max_msgs;
+    rt->admission.max_bytes=admission.max_bytes;
+    rt->admission.max_payload=admission.max_payload;
+    runtime_add_pool_member(rt,&rt->pools[0]);
+    runtime_add_pool_member(rt,&rt->pools[0]);
+    rt->acct_enabled=acct;
+    if(worker_count&&workers_start(rt,worker_count)!=0)
+    {
+        perror("workers");
+        return 1;
+    }
+    // Without offload threads blocking handlers run where the others do.
+    if(offload_threads&&offload_start(rt,offload_threads)!=0)
+    {
+        perror("offload");
+        return 1;
+    }
+    if(trace_path)
+    {
+        if(trace_open(rt,trace_path)!=0)
+        {
+            perror("trace");
+            return 1;
+        }
+        signal(SIGUSR2,trace_on_signal);
+    }
+    if(listen_spec&&node_listen(rt,listen_spec)!=0)
+    {
+        fprintf(stderr,"cannot listen on %s\n",listen_spec);
+        return 1;
+    }
+    for(int i=0;i<proxy_count;i++)
+    {
+        if(node_proxy(rt,proxy_specs[i])!=0)
+        {
+            fprintf(stderr,"bad or unreachable -R %s\n",proxy_specs[i]);
+            return 1;
+        }
+    }
+    if(listen_spec||proxy_count) signal(SIGPIPE,SIG_IGN);
+    // After the node is set up: the metrics thread reads rt->node.
+    MetricsServer metrics={.fd=-1};
+    if(metrics_path&&metrics_start(&metrics,rt,metrics_path)!=0)
+    {
+        perror("metrics");
+        return 1;
+    }
+    int restored=0;
+    if(snapshot_path)
+    {
+        restored=snapshot_restore(rt,snapshot_path);
+        if(restored<0)
+        {
+            fprintf(stderr,"snapshot %s does not match this runtime\n",snapshot_path);
+            return 1;
+        }
+        if(restored)
+            printf("[SNAPSHOT] restored from %s\n",snapshot_path);
+        signal(SIGUSR1,snapshot_on_signal);
+    }
+    if(journal_dir)
+    {
+        long recovered=journal_open(rt,journal_dir);
+        if(recovered<0)
+        {
+            fprintf(stderr,"cannot open journal in %s\n",journal_dir);
+            return 1;
+        }
+        if(recovered>0)
+            printf("[JOURNAL] recovered %ld pending message(s)\n",recovered);
+        restored=rt->journal.seg_no>1;
+    }
+    // Seed Messages belong to the first run only; a restored runtime
+    // already carries their outcome in its counters.
+    if(!restored)
+    {
+        Message m={.to=TARGET_BOTH,.cap=1,.payload="hi Tony."};
+        runtime_route(rt,&m);
+        Message m1={.to=TARGET_A,.cap=1,.payload="hi 大哥."};
+        Message m2={.to=TARGET_B,.cap=2,.payload="hi 小弟."};
+        Message m3={.to=TARGET_BOTH,.cap=2,.payload="both"};
+        runtime_route(rt,&m1);
+        runtime_route(rt,&m2);
+        runtime_route(rt,&m3);
+        Message w1={.to=TARGET_W,.cap=1,.payload="hi pool."};
+        Message w2={.to=TARGET_W,.cap=1,.payload="hi pool again."};
+        runtime_route(rt,&w1);
+        runtime_route(rt,&w2);
+    }
+    for(int i=0;i<RULES_DOER_COUNT;i++)
+    {
+        if(!validate_kind(MSGK_APP,&rt->doers[i])) continue;
+        runtime_subscribe(rt,TOPIC_NEWS,&rt->doers[i]);
+    }
+    if(!restored)
+    {
+        Message n={.kind=MSGK_APP,.cap=1,.payload="news."};
+        runtime_publish(rt,TOPIC_NEWS,&n);
+    }
+/**    while(scheduler_has_work(rt))
+    {
+        scheduler_round(rt);
+    }
+**/
+    long load_balance=0;
+    int snapshot_due=0;
+    if(load_spec)
+        load_balance=load_run(rt,&load);
+    else while(emit_stdin_event(rt))
+    {
+        // Before the drain: the step's input is still in the inboxes.
+        if(snapshot_due)
+        {
+            snapshot_due=0;
+            snapshot_begin(rt,snapshot_path);
+        }
+        scheduler_drain(rt);
+        if(runtime_step_end(rt)!=0)
+        {
+            perror("journal");
+            return 1;
+        }
+        runtime_print_message_balance(rt);
+        runtime_print_admission(rt);
+        if(snapshot_path)
+        {
+            snapshot_reap(0);
+            if(g_snapshot_requested)
+            {
+                g_snapshot_requested=0;
+                // Offloaded jobs live outside the inboxes a snapshot saves.
+                if(offload_settle(rt)!=0)
+                {
+                    perror("journal");
+                    return 1;
+                }
+                snapshot_due=1;
+            }
+        }
+    }
+    // The last acknowledgements arrive after the last step.
+    if(rt->node) runtime_print_message_balance(rt);
+    if(rt->timer->pending)
+        printf("[TIMER] discarded pending=%lu\n",rt->timer->pending);
+    if(snapshot_path)
+    {
+        snapshot_reap(1);
+        if(snapshot_write(rt,snapshot_path)!=0)
+        {
+            perror("snapshot");
+            return 1;
+        }
+        printf("[SNAPSHOT] written to %s\n",snapshot_path);
+    }
+    if(journal_commit(&rt->journal)!=0)
+    {
+        perror("journal");
+        return 1;
+    }
+    runtime_print_drops(rt);
+    runtime_print_costs(rt);
+    int links_bad=node_report(rt);
+    metrics_stop(&metrics);
+    runtime_destroy(rt);
+    if(links_bad) return 1;
+    if(load_balance!=0)
+    {
+        fprintf(stderr,"load: message balance %ld, expected 0\n",load_balance);
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,158 @@
+/* Generated by cmrc from scat10.rules. Do not edit. */
+#ifndef SCAT10_RULES_H
+#define SCAT10_RULES_H
+#include <stdint.h>
+
+#define RULES_DOER_COUNT 8
+#define RULES_POOL_COUNT 1
+#define RULES_CAP_LIMIT 3
+#define RULES_DOER_WORDS 1
+
+typedef enum{
+    TARGET_A,
+    TARGET_B,
+    TARGET_BOTH,
+    TARGET_T,
+    TARGET_PIPE,
+    TARGET_S2,
+    TARGET_S3,
+    TARGET_ALERT,
+    TARGET_G,
+    TARGET_W,
+    TARGET_COUNT
+}Target;
+static const char *const rules_target_names[TARGET_COUNT]={"A","B","BOTH","T","PIPE","S2","S3","ALERT","G","W"};
+
+typedef enum{
+    MSGK_APP,
+    MSGK_STDIN_LINE,
+    MSGK_COUNT
+}MessageKind;
+static const char *const rules_kind_names[MSGK_COUNT]={"app","stdin_line"};
+
+#define RULES_DOERS(X) \
+    X(0,"A") \
+    X(1,"B") \
+    X(2,"T") \
+    X(3,"S1") \
+    X(4,"S2") \
+    X(5,"S3") \
+    X(6,"E") \
+    X(7,"G")
+
+#define RULES_POOLS(X) \
+    X(0,"W",8)
+
+#define RULES_HANDLERS(X) \
+    X(0,MSGK_APP,doer_a_on_app) \
+    X(0,MSGK_STDIN_LINE,doer_a_on_stdin) \
+    X(1,MSGK_APP,doer_b_handle) \
+    X(2,MSGK_STDIN_LINE,doer_t_schedule) \
+    X(3,MSGK_STDIN_LINE,doer_stage) \
+    X(4,MSGK_STDIN_LINE,doer_stage) \
+    X(5,MSGK_STDIN_LINE,doer_stage) \
+    X(6,MSGK_STDIN_LINE,doer_stage) \
+    X(7,MSGK_STDIN_LINE,doer_w_handle) \
+    X(8,MSGK_APP,doer_w_handle) \
+    X(8,MSGK_STDIN_LINE,doer_w_handle)
+
+static const uint32_t rules_kind_mask[9]={0x3,0x1,0x2,0x2,0x2,0x2,0x2,0x2,0x3};
+static const int32_t rules_forward[9]={-1,-1,-1,5,6,8,-1,-1,-1};
+static const int32_t rules_inbox_high[9]={0,0,0,0,0,0,0,0,0};
+static const int32_t rules_inbox_low[9]={0,0,0,0,0,0,0,0,0};
+static const uint32_t rules_blocking_kinds[9]={0x0,0x0,0x0,0x0,0x0,0x0,0x2,0x0,0x0};
+#define RULES_HAS_BLOCKING 1
+static const uint32_t rules_coalesce_kinds[9]={0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x2,0x0};
+static const int32_t rules_doer_affinity[RULES_DOER_COUNT]={1,2,3,0,0,0,4,5};
+#define RULES_AFFINITY_COUNT 6
+static const int32_t rules_fused_next[RULES_DOER_COUNT]={-1,-1,-1,4,5,-1,-1,-1};
+
+#define RULES_STDIN_TARGET TARGET_A
+#define RULES_STDIN_CAP 1
+#define RULES_STDIN_KIND MSGK_STDIN_LINE
+
+// Content routing: Aho-Corasick automaton over byte classes.
+#define RULES_MATCH_COUNT 4
+#define RULES_MATCH_STATES 17
+#define RULES_MATCH_CLASSES 14
+#define RULES_MATCH_START 13
+static const uint8_t rules_match_class[256]={0,1,1,1,1,1,1,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,2,0,0,0,3,0,0,0,0,0,0,0,0,4,5,0,0,6,0,0,0,0,7,0,0,0,0,0,0,0,0,0,8,0,9,0,0,0,0,0,10,0,0,0,0,11,0,12,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+static const uint16_t rules_match_next[RULES_MATCH_STATES][RULES_MATCH_CLASSES]={
+    {0,16,0,0,0,0,0,0,0,0,0,0,11,1},
+    {0,16,0,2,0,0,0,7,0,0,0,0,11,1},
+    {0,16,0,0,0,0,3,0,0,0,0,0,11,1},
+    {0,16,0,0,0,0,4,0,0,0,0,0,11,1},
+    {0,16,0,0,0,5,0,0,0,0,0,0,11,1},
+    {0,16,0,0,0,0,6,0,0,0,0,0,11,1},
+    {0,16,0,0,0,0,0,0,0,0,0,0,11,1},
+    {0,16,8,0,0,0,0,0,0,0,0,0,11,1},
+    {0,16,0,0,0,0,9,0,0,0,0,0,11,1},
+    {0,16,0,0,10,0,0,0,0,0,0,0,11,1},
+    {0,16,0,0,0,0,0,0,0,0,0,0,11,1},
+    {0,16,0,0,0,0,0,0,12,0,0,0,11,1},
+    {0,16,0,0,0,0,0,0,0,0,0,13,11,1},
+    {0,16,0,0,0,0,0,0,0,0,14,0,11,1},
+    {0,16,0,0,0,0,0,0,0,15,0,0,11,1},
+    {0,16,0,0,0,0,0,0,0,0,0,0,11,1},
+    {0,16,0,0,0,0,0,0,0,0,0,0,11,1},
+};
+static const uint64_t rules_match_targets[RULES_MATCH_STATES]={0x0ull,0x0ull,0x0ull,0x0ull,0x0ull,0x0ull,0x80ull,0x0ull,0x0ull,0x0ull,0x81ull,0x0ull,0x0ull,0x0ull,0x0ull,0x80ull,0x80ull};
+
+typedef enum{
+    TOPIC_NEWS,
+    TOPIC_COUNT
+}Topic;
+static const char *const rules_topic_names[1]={"news"};
+static const int32_t rules_topic_cap[1]={1};
+
+// Boundary verbs: perfect hash over (first 8 bytes, length).
+#define RULES_VERB_BITS 5
+#define RULES_VERB_MUL 0x407a3783d8c3f539ull
+#define RULES_VERB_EXIT (-1)
+#define RULES_VERB_GRANT (-2)
+#define RULES_VERB_REVOKE (-3)
+#define RULES_VERB_SUBSCRIBE (-4)
+#define RULES_VERB_UNSUBSCRIBE (-5)
+#define RULES_VERB_PUBLISH (-6)
+typedef struct{
+    uint64_t prefix;
+    uint32_t len;
+    int32_t target;
+    const char *verb;
+}RulesVerb;
+static const RulesVerb rules_verbs[1<<RULES_VERB_BITS]={
+    [0]={0x746e617267ull,5,-2,"grant"},
+    [3]={0x656b6f766572ull,6,-3,"revoke"},
+    [5]={0x61ull,1,0,"a"},
+    [7]={0x74697865ull,4,-1,"exit"},
+    [8]={0x6873696c627570ull,7,-6,"publish"},
+    [10]={0x3273ull,2,5,"s2"},
+    [12]={0x68746f62ull,4,2,"both"},
+    [14]={0x74ull,1,3,"t"},
+    [17]={0x6269726373627573ull,9,-4,"subscribe"},
+    [18]={0x7472656c61ull,5,7,"alert"},
+    [20]={0x65706970ull,4,4,"pipe"},
+    [21]={0x7263736275736e75ull,11,-5,"unsubscribe"},
+    [22]={0x67ull,1,8,"g"},
+    [23]={0x77ull,1,9,"w"},
+    [25]={0x3373ull,2,6,"s3"},
+    [29]={0x62ull,1,1,"b"},
+};
+
+static const uint64_t rules_cap_doers[RULES_CAP_LIMIT][RULES_DOER_WORDS]={
+    {0x0ull},
+    {0x1fdull},
+    {0x2ull},
+};
+
+static const uint32_t rules_route_offset[TARGET_COUNT+1]={0,1,2,4,5,6,7,8,9,10,10};
+static const uint32_t rules_route_doers[10]={0,1,0,1,2,3,4,5,6,7};
+
+static const int32_t rules_route_pool[TARGET_COUNT]={-1,-1,-1,-1,-1,-1,-1,-1,-1,0};
+static const int32_t rules_route_group[TARGET_COUNT]={-1,-1,0,-1,-1,-1,-1,-1,-1,-1};
+#define RULES_GROUP_COUNT 1
+static const uint64_t rules_group_members[1][RULES_DOER_WORDS]={
+    {0x3ull},
+};
+
+#endif
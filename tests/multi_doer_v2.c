@@ -32,6 +32,7 @@ typedef struct {
 
 static void q_init(MsgQueue *mq) { mq->head = mq->tail = 0; }
 static bool q_empty(MsgQueue *mq) { return mq->tail == mq->head; }
+static int q_len(const MsgQueue *mq) { return (mq->tail - mq->head + QMAX) % QMAX; }
 
 static bool q_push(MsgQueue *mq, Message *m) {
     int next = (mq->tail + 1) % QMAX;
@@ -103,8 +104,10 @@ static void run_loop(Doer *root, Doer *wA, Doer *wB) {
                 break;
             }
 
-            if (turn == 0) q_push(&wA->inbox, &msg);
-            else           q_push(&wB->inbox, &msg);
+            /* 派给积压更少的 worker；积压相同时轮换 */
+            int la = q_len(&wA->inbox), lb = q_len(&wB->inbox);
+            Doer *pick = la < lb ? wA : lb < la ? wB : (turn == 0 ? wA : wB);
+            q_push(&pick->inbox, &msg);
 
             turn ^= 1;
         }
@@ -93,6 +93,36 @@ static void scheduler_drain(Doer **doers, int count) {
     }
 }
 
+/* ===== 字段切分（代替 sscanf） ===== */
+
+static const char *skip_blank(const char *p) {
+    while (*p == ' ' || *p == '\t') p++;
+    return p;
+}
+
+/* 切出下一个空白分隔的字段，最多 cap-1 字节（超长部分丢弃）。
+   返回字段之后的位置；没有字段返回 NULL */
+static const char *next_field(const char *p, char *out, size_t cap) {
+    p = skip_blank(p);
+    if (*p == '\0') return NULL;
+    size_t n = 0;
+    while (*p && *p != ' ' && *p != '\t') {
+        if (n + 1 < cap) out[n++] = *p;
+        p++;
+    }
+    out[n] = '\0';
+    return p;
+}
+
+/* 剩余文本（去掉前导空白）作为最后一个字段；为空返回 false */
+static bool rest_field(const char *p, char *out, size_t cap) {
+    p = skip_blank(p);
+    if (*p == '\0') return false;
+    strncpy(out, p, cap - 1);
+    out[cap - 1] = '\0';
+    return true;
+}
+
 /* ===== root 命令解析 ===== */
 /*
     支持指令：
@@ -128,7 +158,7 @@ static bool parse_and_dispatch(
     if (strncmp(line, "spawn ", 6) == 0) {
         char new_name[NAME_LEN + 1];
 
-        if (sscanf(line + 6, "%31s", new_name) == 1) {
+        if (next_field(line + 6, new_name, sizeof(new_name))) {
             if (strcmp(new_name, root->name) == 0) {
                 printf("[root] 不能使用保留名字 '%s'\n", root->name);
                 return true;
@@ -164,7 +194,9 @@ static bool parse_and_dispatch(
         char dst[NAME_LEN + 1];
         char msg[PAYLOAD_LEN + 1];
 
-        if (sscanf(line + 5, "%31s %31s %127[^\n]", src, dst, msg) == 3) {
+        const char *p = next_field(line + 5, src, sizeof(src));
+        if (p) p = next_field(p, dst, sizeof(dst));
+        if (p && rest_field(p, msg, sizeof(msg))) {
             Doer *fromD = NULL;
             if (strcmp(src, root->name) == 0) {
                 fromD = root;